@@ -0,0 +1,137 @@
+#include "common.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+
+namespace {
+    void usage(const char *name, const BENCHMARK::Options &defaults, const std::string &extra_usage) {
+        std::cout << "Usage: " << name << " [options]\n"
+                  << "  --rows N          rows per slice (" << defaults.phantom.rows << ")\n"
+                  << "  --cols N          columns per slice (" << defaults.phantom.cols << ")\n"
+                  << "  --slices N        number of slices (" << defaults.phantom.slices << ")\n"
+                  << "  --modality MR|CT  research type (" << defaults.phantom.modality << ")\n"
+                  << "  --syntax S        explicit | jpeg | jpegls | rle ("
+                  << PHANTOM::syntaxName(defaults.phantom.syntax) << ")\n"
+                  << extra_usage
+                  << "  --repeat N        runs per measurement, best is reported (" << defaults.repeat << ")\n"
+                  << "  --dir PATH        working directory (temporary by default)\n"
+                  << "  --keep            do not remove the working directory afterwards\n";
+    }
+}
+
+double BENCHMARK::elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int BENCHMARK::run(int argc, char **argv,
+                   Options options,
+                   const std::string &prefix,
+                   const std::string &extra_usage,
+                   const Parser &parser,
+                   const std::function<void(const Options &options)> &measure) {
+    const Options defaults = options;
+    try {
+        for(int i = 1; i < argc; ++i) {
+            std::string option = argv[i];
+            Value value = [&]() -> std::string {
+                if(i + 1 >= argc)
+                    throw std::invalid_argument("missing value for " + option);
+                return argv[++i];
+            };
+            if(option == "--rows")
+                options.phantom.rows = static_cast<uint16_t>(std::stoi(value()));
+            else if(option == "--cols")
+                options.phantom.cols = static_cast<uint16_t>(std::stoi(value()));
+            else if(option == "--slices")
+                options.phantom.slices = std::stoi(value());
+            else if(option == "--modality")
+                options.phantom.modality = value();
+            else if(option == "--syntax") {
+                std::string name = value();
+                if(!PHANTOM::parseSyntax(name, options.phantom.syntax))
+                    throw std::invalid_argument("unknown transfer syntax " + name);
+            }
+            else if(option == "--repeat")
+                options.repeat = std::max(1, std::stoi(value()));
+            else if(option == "--dir")
+                options.directory = value();
+            else if(option == "--keep")
+                options.keep = true;
+            else if(!parser || !parser(option, value)) {
+                usage(argv[0], defaults, extra_usage);
+                return option == "--help" ? 0 : 1;
+            }
+        }
+    } catch(const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        usage(argv[0], defaults, extra_usage);
+        return 1;
+    }
+
+    if(options.directory.empty())
+        options.directory = (std::filesystem::temp_directory_path() /
+                             (prefix + std::to_string(getpid()))).string();
+
+    int status = 0;
+    try {
+        measure(options);
+    } catch(const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+
+    if(!options.keep) {
+        std::error_code error;
+        std::filesystem::remove_all(options.directory, error);
+    }
+    return status;
+}
+
+void BENCHMARK::writePhantom(const std::string &directory, const PHANTOM::Parameters &parameters) {
+    std::cout << "Writing phantom " << parameters.cols << "x" << parameters.rows << "x"
+              << parameters.slices << " " << parameters.modality << " ("
+              << PHANTOM::syntaxName(parameters.syntax) << ") to " << directory << std::endl;
+    auto start = Clock::now();
+    PHANTOM::write(directory, parameters);
+    std::cout << "Phantom written in " << elapsed_ms(start) << " ms" << std::endl;
+}
+
+std::shared_ptr<const STUDY_VOLUME::Volume> BENCHMARK::loadPhantom(const std::string &directory,
+                                                                    const PHANTOM::Parameters &parameters) {
+    const std::string phantom_directory = directory + "/phantom";
+    writePhantom(phantom_directory, parameters);
+    std::shared_ptr<const STUDY_VOLUME::Volume> volume = STUDY_VOLUME::read(phantom_directory);
+    if(!volume)
+        throw std::runtime_error("phantom was not loaded");
+    return volume;
+}
+
+std::vector<unsigned> BENCHMARK::parseList(const std::string &list) {
+    std::vector<unsigned> result;
+    std::stringstream stream(list);
+    std::string item;
+    while(std::getline(stream, item, ',')) {
+        if(item.empty())
+            continue;
+        long value = std::stol(item);
+        if(value <= 0)
+            throw std::invalid_argument("value must be positive: " + item);
+        result.push_back(static_cast<unsigned>(value));
+    }
+    return result;
+}
+
+std::vector<unsigned> BENCHMARK::defaultThreads() {
+    unsigned cores = std::thread::hardware_concurrency();
+    std::vector<unsigned> result;
+    for(unsigned n = 1; n < cores; n *= 2)
+        result.push_back(n);
+    result.push_back(cores ? cores : 1);
+    return result;
+}
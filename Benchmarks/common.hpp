@@ -0,0 +1,67 @@
+#ifndef BENCHMARK_COMMON_HPP
+#define BENCHMARK_COMMON_HPP
+
+#include "phantom.hpp"
+#include "Model/study_volume.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/// Общая обвязка замеров на фантоме: разбор параметров командной строки,
+/// рабочая директория и ее удаление, таймер. В main каждого замера
+/// остается только сам замер
+namespace BENCHMARK {
+    using Clock = std::chrono::steady_clock;
+
+    /// @brief Время от start до текущего момента, мс
+    double elapsed_ms(Clock::time_point start);
+
+    /// Общие параметры замеров
+    struct Options {
+        PHANTOM::Parameters phantom;    /// Параметры фантома
+        int                 repeat = 1; /// Прогонов на замер, выводится лучший
+        std::string         directory;  /// Рабочая директория (по умолчанию временная)
+        bool                keep = false; /// Не удалять рабочую директорию
+    };
+
+    /// Значение текущего параметра командной строки
+    using Value = std::function<std::string()>;
+
+    /// Разбор параметров конкретного замера.
+    /// @return false, если параметр неизвестен
+    using Parser = std::function<bool(const std::string &option, const Value &value)>;
+
+    /// @brief Разбирает параметры, создает рабочую директорию и выполняет замер.
+    /// Исключения замера выводятся в std::cerr, директория после него удаляется (без --keep)
+    /// @param prefix Префикс имени временной директории
+    /// @param extra_usage Строки справки по собственным параметрам замера
+    /// @param parser Разбор собственных параметров (может быть пустым)
+    /// @param measure Замер, получает параметры с заполненной рабочей директорией
+    /// @return Код завершения программы
+    int run(int argc, char **argv,
+            Options options,
+            const std::string &prefix,
+            const std::string &extra_usage,
+            const Parser &parser,
+            const std::function<void(const Options &options)> &measure);
+
+    /// @brief Записывает фантом в директорию и выводит время записи
+    void writePhantom(const std::string &directory, const PHANTOM::Parameters &parameters);
+
+    /// @brief Записывает фантом в <directory>/phantom и читает его как исследование
+    std::shared_ptr<const STUDY_VOLUME::Volume> loadPhantom(const std::string &directory,
+                                                             const PHANTOM::Parameters &parameters);
+
+    /// @brief Разбирает список положительных чисел через запятую
+    std::vector<unsigned> parseList(const std::string &list);
+
+    /// @brief Числа потоков по умолчанию: степени двойки до числа ядер и само число ядер
+    std::vector<unsigned> defaultThreads();
+}
+
+
+#endif //BENCHMARK_COMMON_HPP
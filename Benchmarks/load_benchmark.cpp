@@ -0,0 +1,122 @@
+#include "common.hpp"
+#include "Model/head_cloud.hpp"
+#include "Model/intensity.hpp"
+#include "Model/parallel.hpp"
+
+#include <vtkMultiThreader.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+
+/// Замер пути загрузки исследования на синтетическом фантоме.
+/// Фантом записывается во временную директорию, затем для каждого числа потоков
+/// несколько раз выполняются этапы загрузки, и выводится лучшее время каждого этапа
+namespace {
+    using BENCHMARK::Clock;
+    using BENCHMARK::elapsed_ms;
+
+    /// Лучшее время этапов по числу потоков: stage -> threads -> ms
+    using Results = std::map<std::string, std::map<unsigned, double>>;
+
+    /// Этапы в порядке выполнения
+    const std::vector<std::string> STAGES = {
+        "index", "decode", "HeadCloud()", "sort()", "equalizeImages()", "orient", "total"
+    };
+
+    void record(Results &results, const std::string &stage, unsigned threads, double ms) {
+        auto &best = results[stage];
+        auto found = best.find(threads);
+        if(found == best.end() || ms < found->second)
+            best[threads] = ms;
+    }
+
+    /// @brief Один прогон всех этапов загрузки
+    void run(const std::string &directory, unsigned threads, Results &results) {
+        auto total = Clock::now();
+
+        auto start = Clock::now();
+        DICOM_LOADER::StudyIndex index = DICOM_LOADER::index(directory);
+        record(results, "index", threads, elapsed_ms(start));
+
+        start = Clock::now();
+        std::shared_ptr<const STUDY_VOLUME::Volume> volume = STUDY_VOLUME::read(index);
+        if(!volume)
+            throw std::runtime_error("phantom was not loaded");
+        record(results, "decode", threads, elapsed_ms(start));
+
+        start = Clock::now();
+        HEAD_POINT_CLOUD::HeadCloud cloud(volume);
+        record(results, "HeadCloud()", threads, elapsed_ms(start));
+
+        start = Clock::now();
+        cloud.sort();
+        record(results, "sort()", threads, elapsed_ms(start));
+
+        start = Clock::now();
+        cloud.equalizeImages();
+        record(results, "equalizeImages()", threads, elapsed_ms(start));
+
+        start = Clock::now();
+        vtkSmartPointer<vtkImageData> oriented = STUDY_VOLUME::orient(*volume);
+        record(results, "orient", threads, elapsed_ms(start));
+
+        record(results, "total", threads, elapsed_ms(total));
+    }
+
+    void printResults(const Results &results, const std::vector<unsigned> &threads) {
+        std::cout << "\n" << std::left << std::setw(20) << "stage, ms";
+        for(unsigned n: threads)
+            std::cout << std::right << std::setw(10) << (std::to_string(n) + " thr");
+        std::cout << "\n";
+        for(auto &stage: STAGES) {
+            auto found = results.find(stage);
+            if(found == results.end())
+                continue;
+            std::cout << std::left << std::setw(20) << stage;
+            for(unsigned n: threads)
+                std::cout << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+                          << found->second.at(n);
+            std::cout << "\n";
+        }
+        // Ускорение относительно первого столбца
+        auto total = results.find("total");
+        if(total != results.end() && !threads.empty()) {
+            std::cout << std::left << std::setw(20) << "speedup";
+            for(unsigned n: threads)
+                std::cout << std::right << std::setw(10) << std::setprecision(2)
+                          << total->second.at(threads.front()) / total->second.at(n);
+            std::cout << "\n";
+        }
+        std::cout << std::flush;
+    }
+}
+
+int main(int argc, char **argv) {
+    BENCHMARK::Options defaults;
+    defaults.repeat = 3;
+    std::vector<unsigned> threads = BENCHMARK::defaultThreads();
+
+    return BENCHMARK::run(argc, argv, defaults, "vtk_viewer_phantom_",
+                          "  --threads LIST    comma separated thread counts (1,2,4,...,cores)\n",
+                          [&](const std::string &option, const BENCHMARK::Value &value) {
+        if(option != "--threads")
+            return false;
+        threads = BENCHMARK::parseList(value());
+        return true;
+    }, [&](const BENCHMARK::Options &options) {
+        BENCHMARK::writePhantom(options.directory, options.phantom);
+        std::cout << "Intensity kernels: " << INTENSITY::implementation() << std::endl;
+
+        Results results;
+        for(unsigned n: threads) {
+            PARALLEL::setThreads(n);
+            vtkMultiThreader::SetGlobalMaximumNumberOfThreads(static_cast<int>(n));
+            for(int r = 0; r != options.repeat; ++r)
+                run(options.directory, n, results);
+        }
+        PARALLEL::setThreads(0);
+        printResults(results, threads);
+    });
+}
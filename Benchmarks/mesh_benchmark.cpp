@@ -0,0 +1,139 @@
+#include "common.hpp"
+#include "Model/model_builder.hpp"
+
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkTriangleFilter.h>
+#include <vtkMassProperties.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+/// Сравнение способов построения модели (MODEL_BUILDER::Backend) на синтетическом фантоме.
+/// Для каждого способа выводится лучшее время построения и качество поверхности
+/// относительно известной внешней границы кожи фантома (эллипсоида)
+namespace {
+    /// Качество поверхности относительно эллипсоида
+    struct Quality {
+        vtkIdType points = 0;
+        vtkIdType cells = 0;
+        double area = 0.0;          /// Площадь поверхности, мм^2
+        double volume = 0.0;        /// Объем, мм^3
+        double mean_distance = 0.0; /// Среднее расстояние вершин до эллипсоида, мм
+        double max_distance = 0.0;  /// Наибольшее расстояние вершин до эллипсоида, мм
+    };
+
+    std::vector<MODEL_BUILDER::Backend> parseBackends(const std::string &list) {
+        std::vector<MODEL_BUILDER::Backend> result;
+        std::stringstream stream(list);
+        std::string item;
+        while(std::getline(stream, item, ',')) {
+            MODEL_BUILDER::Backend backend;
+            if(!MODEL_BUILDER::parseBackend(item, backend))
+                throw std::invalid_argument("unknown backend " + item);
+            result.push_back(backend);
+        }
+        return result;
+    }
+
+    /// @brief Приближенное расстояние до эллипсоида вдоль радиуса из его центра
+    double ellipsoidDistance(const double point[3], const std::array<double, 3> &axes) {
+        double q[3] = {point[0] / axes[0], point[1] / axes[1], point[2] / axes[2]};
+        double r = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+        double length = std::sqrt(point[0] * point[0] + point[1] * point[1] + point[2] * point[2]);
+        if(r == 0.0)
+            return std::min({axes[0], axes[1], axes[2]});
+        return std::abs(r - 1.0) * length / r;
+    }
+
+    Quality measure(vtkPolyData *model, const std::array<double, 3> &axes) {
+        Quality quality;
+        quality.points = model->GetNumberOfPoints();
+        quality.cells = model->GetNumberOfCells();
+        if(!quality.points)
+            return quality;
+
+        vtkNew<vtkTriangleFilter> triangles;
+        triangles->SetInputData(model);
+        vtkNew<vtkMassProperties> mass;
+        mass->SetInputConnection(triangles->GetOutputPort());
+        mass->Update();
+        quality.area = mass->GetSurfaceArea();
+        quality.volume = mass->GetVolume();
+
+        double sum = 0.0;
+        double point[3];
+        for(vtkIdType i = 0; i != quality.points; ++i) {
+            model->GetPoint(i, point);
+            double distance = ellipsoidDistance(point, axes);
+            sum += distance;
+            quality.max_distance = std::max(quality.max_distance, distance);
+        }
+        quality.mean_distance = sum / quality.points;
+        return quality;
+    }
+
+    /// @brief Площадь эллипсоида (приближение Томсена, ошибка до 1.1%)
+    double ellipsoidArea(const std::array<double, 3> &axes) {
+        const double p = 1.6075;
+        double ab = std::pow(axes[0] * axes[1], p);
+        double ac = std::pow(axes[0] * axes[2], p);
+        double bc = std::pow(axes[1] * axes[2], p);
+        return 4.0 * M_PI * std::pow((ab + ac + bc) / 3.0, 1.0 / p);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<MODEL_BUILDER::Backend> backends = {MODEL_BUILDER::Backend::ScaleSpace,
+                                                    MODEL_BUILDER::Backend::IsoSurface};
+
+    return BENCHMARK::run(argc, argv, BENCHMARK::Options(), "vtk_viewer_mesh_",
+                          "  --backend LIST    comma separated: scale_space, iso_surface (both)\n",
+                          [&](const std::string &option, const BENCHMARK::Value &value) {
+        if(option != "--backend")
+            return false;
+        backends = parseBackends(value());
+        return true;
+    }, [&](const BENCHMARK::Options &options) {
+        std::shared_ptr<const STUDY_VOLUME::Volume> volume =
+                BENCHMARK::loadPhantom(options.directory, options.phantom);
+        const std::string model_directory = options.directory + "/models";
+
+        const std::array<double, 3> axes = PHANTOM::skinAxes(options.phantom);
+        const double reference_area = ellipsoidArea(axes);
+        const double reference_volume = 4.0 / 3.0 * M_PI * axes[0] * axes[1] * axes[2];
+
+        std::cout << "\n" << std::left << std::setw(14) << "backend"
+                  << std::right << std::setw(12) << "time, ms"
+                  << std::setw(10) << "points" << std::setw(10) << "cells"
+                  << std::setw(10) << "area, %" << std::setw(10) << "volume, %"
+                  << std::setw(12) << "mean, mm" << std::setw(10) << "max, mm" << "\n";
+        for(MODEL_BUILDER::Backend backend: backends) {
+            const std::string name = MODEL_BUILDER::backendName(backend);
+            double best = 0.0;
+            vtkSmartPointer<vtkPolyData> model;
+            for(int r = 0; r != options.repeat; ++r) {
+                auto start = BENCHMARK::Clock::now();
+                model = MODEL_BUILDER::build(volume, model_directory, name, std::string(), backend, false);
+                double ms = BENCHMARK::elapsed_ms(start);
+                if(r == 0 || ms < best)
+                    best = ms;
+            }
+
+            Quality quality = measure(model, axes);
+            std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+                      << std::setw(12) << std::setprecision(1) << best
+                      << std::setw(10) << quality.points << std::setw(10) << quality.cells
+                      << std::setw(10) << std::setprecision(2) << 100.0 * quality.area / reference_area
+                      << std::setw(10) << 100.0 * quality.volume / reference_volume
+                      << std::setw(12) << std::setprecision(3) << quality.mean_distance
+                      << std::setw(10) << quality.max_distance << "\n";
+        }
+        std::cout << "(area and volume relative to the phantom skin ellipsoid "
+                  << axes[0] << " x " << axes[1] << " x " << axes[2] << " mm)" << std::endl;
+    });
+}
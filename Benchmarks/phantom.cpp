@@ -0,0 +1,219 @@
+#include "phantom.hpp"
+#include "Model/parallel.hpp"
+
+#include "dcmtk/dcmdata/dctk.h"
+#include "dcmtk/dcmdata/dcrleerg.h"
+#include "dcmtk/dcmjpeg/djencode.h"
+#include "dcmtk/dcmjpeg/djrplol.h"
+#include "dcmtk/dcmjpls/djencode.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace {
+    /// Полуоси эллипсоида в долях размера объема
+    constexpr double AXIS_COLS = 0.42;
+    constexpr double AXIS_ROWS = 0.48;
+    constexpr double AXIS_SLICES = 0.45;
+
+    /// Интенсивности оболочек фантома
+    struct Tissues {
+        int16_t background;
+        int16_t skin;
+        int16_t bone;
+        int16_t brain;
+        int16_t noise;
+    };
+
+    Tissues tissues(const std::string &modality) {
+        // КТ - в единицах Хаунсфилда, МРТ - типичные значения T1
+        if(modality == "CT")
+            return {-1000, 40, 1200, 30, 10};
+        return {0, 900, 150, 500, 20};
+    }
+
+    E_TransferSyntax transferSyntax(PHANTOM::Syntax syntax) {
+        switch(syntax) {
+            case PHANTOM::Syntax::JPEGLossless: return EXS_JPEGProcess14SV1;
+            case PHANTOM::Syntax::JPEGLS:       return EXS_JPEGLSLossless;
+            case PHANTOM::Syntax::RLE:          return EXS_RLELossless;
+            default:                            return EXS_LittleEndianExplicit;
+        }
+    }
+
+    void registerEncoders() {
+        /// Регистрация кодеков глобальна для процесса, выполняется один раз
+        static std::once_flag registered;
+        std::call_once(registered, []() {
+            DJEncoderRegistration::registerCodecs();
+            DJLSEncoderRegistration::registerCodecs();
+            DcmRLEEncoderRegistration::registerCodecs();
+        });
+    }
+
+    std::string uid(const char *root) {
+        char buffer[100];
+        return dcmGenerateUniqueIdentifier(buffer, root);
+    }
+
+    std::string join(std::initializer_list<double> values) {
+        std::ostringstream stream;
+        stream.imbue(std::locale::classic());
+        bool first = true;
+        for(double value: values) {
+            if(!first)
+                stream << '\\';
+            stream << value;
+            first = false;
+        }
+        return stream.str();
+    }
+
+    void check(const OFCondition &condition, const std::string &what) {
+        if(condition.bad())
+            throw std::runtime_error(what + ": " + condition.text());
+    }
+
+    /// @brief Заполняет срез k: эллипсоид вписан в объем с небольшим отступом
+    void fillSlice(const PHANTOM::Parameters &parameters, int k, std::vector<int16_t> &pixels) {
+        const Tissues values = tissues(parameters.modality);
+        const double a = AXIS_COLS * parameters.cols;
+        const double b = AXIS_ROWS * parameters.rows;
+        const double c = AXIS_SLICES * parameters.slices;
+        const double z = (k - parameters.slices / 2.0) / c;
+
+        // Шум детерминирован номером среза, чтобы замеры повторялись
+        std::mt19937 random(static_cast<unsigned>(k));
+        std::uniform_int_distribution<int> noise(-values.noise, values.noise);
+        for(int row = 0; row != parameters.rows; ++row) {
+            double y = (row - parameters.rows / 2.0) / b;
+            for(int col = 0; col != parameters.cols; ++col) {
+                double x = (col - parameters.cols / 2.0) / a;
+                double r = std::sqrt(x * x + y * y + z * z);
+                int value = r > 1.0  ? values.background
+                          : r > 0.95 ? values.skin
+                          : r > 0.88 ? values.bone
+                          : values.brain;
+                value += noise(random);
+                if(parameters.modality != "CT")
+                    value = std::max(0, value);
+                pixels[static_cast<size_t>(row) * parameters.cols + col] = static_cast<int16_t>(value);
+            }
+        }
+    }
+}
+
+bool PHANTOM::parseSyntax(const std::string &name, Syntax &syntax) {
+    if(name == "explicit")
+        syntax = Syntax::Explicit;
+    else if(name == "jpeg")
+        syntax = Syntax::JPEGLossless;
+    else if(name == "jpegls")
+        syntax = Syntax::JPEGLS;
+    else if(name == "rle")
+        syntax = Syntax::RLE;
+    else
+        return false;
+    return true;
+}
+
+std::string PHANTOM::syntaxName(Syntax syntax) {
+    switch(syntax) {
+        case Syntax::JPEGLossless: return "jpeg";
+        case Syntax::JPEGLS:       return "jpegls";
+        case Syntax::RLE:          return "rle";
+        default:                   return "explicit";
+    }
+}
+
+std::array<double, 3> PHANTOM::skinAxes(const Parameters &parameters) {
+    return {AXIS_COLS * parameters.cols * parameters.pixel_spacing,
+            AXIS_ROWS * parameters.rows * parameters.pixel_spacing,
+            AXIS_SLICES * parameters.slices * parameters.slice_spacing};
+}
+
+std::vector<std::string> PHANTOM::write(const std::string &directory, const Parameters &parameters) {
+    if(parameters.rows == 0 || parameters.cols == 0 || parameters.slices <= 0)
+        throw std::invalid_argument("empty phantom");
+    registerEncoders();
+    std::filesystem::create_directories(directory);
+
+    const bool ct = parameters.modality == "CT";
+    const E_TransferSyntax xfer = transferSyntax(parameters.syntax);
+    const std::string study_uid = uid(SITE_STUDY_UID_ROOT);
+    const std::string series_uid = uid(SITE_SERIES_UID_ROOT);
+
+    /// Имена файлов перемешаны, чтобы индекс и сортировка выполняли настоящую работу
+    std::vector<int> names(parameters.slices);
+    std::iota(names.begin(), names.end(), 0);
+    if(parameters.shuffle)
+        std::shuffle(names.begin(), names.end(), std::mt19937(42));
+
+    std::vector<std::string> paths(parameters.slices);
+    const size_t slice_size = static_cast<size_t>(parameters.rows) * parameters.cols;
+    PARALLEL::parallel_for(parameters.slices, [&](size_t k) {
+        std::vector<int16_t> pixels(slice_size);
+        fillSlice(parameters, static_cast<int>(k), pixels);
+
+        DcmFileFormat file;
+        DcmDataset *dataset = file.getDataset();
+        dataset->putAndInsertString(DCM_SOPClassUID, ct ? UID_CTImageStorage : UID_MRImageStorage);
+        dataset->putAndInsertString(DCM_SOPInstanceUID, uid(SITE_INSTANCE_UID_ROOT).c_str());
+        dataset->putAndInsertString(DCM_StudyInstanceUID, study_uid.c_str());
+        dataset->putAndInsertString(DCM_SeriesInstanceUID, series_uid.c_str());
+        dataset->putAndInsertString(DCM_Modality, parameters.modality.c_str());
+        dataset->putAndInsertString(DCM_PatientName, "PHANTOM^HEAD");
+        dataset->putAndInsertString(DCM_PatientID, "PHANTOM");
+        dataset->putAndInsertString(DCM_InstanceNumber, std::to_string(k + 1).c_str());
+
+        // Аксиальные срезы, центр объема в начале координат пациента
+        double x0 = -parameters.cols * parameters.pixel_spacing / 2.0;
+        double y0 = -parameters.rows * parameters.pixel_spacing / 2.0;
+        double z0 = (k - parameters.slices / 2.0) * parameters.slice_spacing;
+        dataset->putAndInsertString(DCM_ImagePositionPatient, join({x0, y0, z0}).c_str());
+        dataset->putAndInsertString(DCM_ImageOrientationPatient, "1\\0\\0\\0\\1\\0");
+        dataset->putAndInsertString(DCM_PixelSpacing,
+                                    join({parameters.pixel_spacing, parameters.pixel_spacing}).c_str());
+        dataset->putAndInsertString(DCM_SliceThickness, join({parameters.slice_spacing}).c_str());
+        if(ct) {
+            dataset->putAndInsertString(DCM_RescaleIntercept, "0");
+            dataset->putAndInsertString(DCM_RescaleSlope, "1");
+        }
+
+        dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+        dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+        dataset->putAndInsertUint16(DCM_Rows, parameters.rows);
+        dataset->putAndInsertUint16(DCM_Columns, parameters.cols);
+        dataset->putAndInsertUint16(DCM_BitsAllocated, 16);
+        dataset->putAndInsertUint16(DCM_BitsStored, 12);
+        dataset->putAndInsertUint16(DCM_HighBit, 11);
+        dataset->putAndInsertUint16(DCM_PixelRepresentation, ct ? 1 : 0);
+        check(dataset->putAndInsertUint16Array(DCM_PixelData,
+                                               reinterpret_cast<const Uint16*>(pixels.data()),
+                                               static_cast<unsigned long>(slice_size)),
+              "cannot insert pixel data");
+
+        if(xfer == EXS_JPEGProcess14SV1) {
+            DJ_RPLossless lossless;
+            check(dataset->chooseRepresentation(xfer, &lossless), "cannot encode slice");
+        } else if(xfer != EXS_LittleEndianExplicit) {
+            check(dataset->chooseRepresentation(xfer, nullptr), "cannot encode slice");
+        }
+        if(!dataset->canWriteXfer(xfer))
+            throw std::runtime_error("cannot write transfer syntax " + syntaxName(parameters.syntax));
+
+        char name[16];
+        std::snprintf(name, sizeof(name), "IM%05d", names[k]);
+        paths[k] = (std::filesystem::path(directory) / name).string();
+        check(file.saveFile(paths[k].c_str(), xfer), "cannot save " + paths[k]);
+    });
+    return paths;
+}
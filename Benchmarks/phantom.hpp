@@ -0,0 +1,52 @@
+#ifndef PHANTOM_HPP
+#define PHANTOM_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+/// Синтетические исследования головы для воспроизводимых замеров загрузки:
+/// эллипсоид из трех оболочек (кожа, кость, мозг) на фоне с шумом
+namespace PHANTOM {
+    /// Синтаксис передачи, в котором сохраняются файлы
+    enum class Syntax {
+        Explicit,       /// Без сжатия (Explicit VR Little Endian)
+        JPEGLossless,   /// JPEG Lossless, Process 14 SV1
+        JPEGLS,         /// JPEG-LS Lossless
+        RLE             /// RLE Lossless
+    };
+
+    /// Параметры фантома
+    struct Parameters {
+        uint16_t    rows = 256;             /// Количество строк среза
+        uint16_t    cols = 256;             /// Количество столбцов среза
+        int         slices = 160;           /// Количество срезов
+        std::string modality = "MR";        /// Тип исследования (MR/CT)
+        Syntax      syntax = Syntax::Explicit;
+        float       pixel_spacing = 1.0f;   /// Расстояние между пикселями, мм
+        float       slice_spacing = 1.0f;   /// Расстояние между срезами, мм
+        bool        shuffle = true;         /// Имена файлов не совпадают с порядком срезов
+    };
+
+    /// @brief Разбирает название синтаксиса (explicit, jpeg, jpegls, rle)
+    /// @return false, если название неизвестно
+    bool parseSyntax(const std::string &name, Syntax &syntax);
+
+    /// @brief Название синтаксиса для вывода
+    std::string syntaxName(Syntax syntax);
+
+    /// @brief Полуоси внешней границы кожи в координатах пациента, мм.
+    /// Центр эллипсоида совпадает с началом координат
+    std::array<double, 3> skinAxes(const Parameters &parameters);
+
+    /// @brief Записывает фантом в директорию (параллельно, по файлу на срез)
+    /// @param directory Директория (создается при необходимости)
+    /// @param parameters Параметры фантома
+    /// @return Пути к записанным файлам в порядке срезов
+    std::vector<std::string> write(const std::string &directory, const Parameters &parameters);
+}
+
+
+#endif //PHANTOM_HPP
@@ -0,0 +1,73 @@
+#include "common.hpp"
+#include "Model/decimation.hpp"
+#include "Model/head_cloud.hpp"
+#include "Model/model_builder.hpp"
+#include "Model/parallel.hpp"
+
+#include <iomanip>
+#include <iostream>
+
+
+/// Ускорение реконструкции CGAL (MODEL_BUILDER::reconstruct) от числа потоков.
+/// Облако поверхности фантома прореживается до нескольких размеров, для каждого
+/// размера реконструкция запускается с разным ограничением PARALLEL::setThreads.
+/// Реконструкция не меняет облако, поэтому все прогоны идут по одному и тому же
+int main(int argc, char **argv) {
+    std::vector<unsigned> sizes = {10000, 25000, 50000};
+    std::vector<unsigned> threads = BENCHMARK::defaultThreads();
+
+    return BENCHMARK::run(argc, argv, BENCHMARK::Options(), "vtk_viewer_reconstruction_",
+                          "  --points LIST     comma separated cloud sizes (10000,25000,50000)\n"
+                          "  --threads LIST    comma separated thread counts (1,2,4,...,cores)\n",
+                          [&](const std::string &option, const BENCHMARK::Value &value) {
+        if(option == "--points")
+            sizes = BENCHMARK::parseList(value());
+        else if(option == "--threads")
+            threads = BENCHMARK::parseList(value());
+        else
+            return false;
+        return true;
+    }, [&](const BENCHMARK::Options &options) {
+        std::shared_ptr<const STUDY_VOLUME::Volume> volume =
+                BENCHMARK::loadPhantom(options.directory, options.phantom);
+
+        // Полное облако без прореживания, дальше оно прореживается до каждого размера
+        HEAD_POINT_CLOUD::HeadCloud head(volume);
+        head.sort();
+        head.equalizeImages();
+        head.setDecimation(DECIMATION::Target{0.0f, 0});
+        const VOXEL_TRANSFORM::Points surface = head.headSurfacePoints();
+        std::cout << "Surface cloud: " << surface.size() << " points, concurrency "
+                  << MODEL_BUILDER::concurrency() << "\n";
+
+        std::cout << "\n" << std::right << std::setw(10) << "points"
+                  << std::setw(10) << "threads" << std::setw(12) << "time, ms"
+                  << std::setw(10) << "speedup" << std::setw(10) << "cells" << "\n";
+        for(unsigned size: sizes) {
+            const std::vector<cv::Point3f> cloud =
+                    DECIMATION::decimate(surface, DECIMATION::Target{0.0f, size}).toPoint3f();
+            double baseline = 0.0;
+            for(unsigned n: threads) {
+                PARALLEL::setThreads(n);
+                double best = 0.0;
+                vtkIdType cells = 0;
+                for(int r = 0; r != options.repeat; ++r) {
+                    auto start = BENCHMARK::Clock::now();
+                    vtkSmartPointer<vtkPolyData> model = MODEL_BUILDER::reconstruct(cloud);
+                    double ms = BENCHMARK::elapsed_ms(start);
+                    if(r == 0 || ms < best)
+                        best = ms;
+                    cells = model ? model->GetNumberOfCells() : 0;
+                }
+                if(baseline == 0.0)
+                    baseline = best;
+                std::cout << std::setw(10) << cloud.size() << std::setw(10) << n << std::fixed
+                          << std::setw(12) << std::setprecision(1) << best
+                          << std::setw(10) << std::setprecision(2) << (best > 0.0 ? baseline / best : 0.0)
+                          << std::setw(10) << cells << "\n";
+            }
+        }
+        PARALLEL::setThreads(0);
+        std::cout << "(speedup relative to the first thread count of each size)" << std::endl;
+    });
+}
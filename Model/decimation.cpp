@@ -0,0 +1,134 @@
+#include "decimation.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+namespace {
+    /// Разрядов на одну координату куба в ключе
+    constexpr int KEY_BITS = 21;
+    constexpr uint64_t KEY_MASK = (uint64_t(1) << KEY_BITS) - 1;
+    /// Точек в одной задаче при вычислении ключей
+    constexpr size_t BLOCK = 1 << 16;
+    /// Допустимое отклонение количества точек от требуемого при подборе шага
+    constexpr double COUNT_TOLERANCE = 0.02;
+    constexpr int MAX_ITERATIONS = 8;
+
+    /// Точка облака и ключ ее куба
+    struct Cell {
+        uint64_t key;
+        size_t index;
+    };
+
+    std::array<float, 3> minimum(const VOXEL_TRANSFORM::Points &cloud) {
+        return {*std::min_element(cloud.x.begin(), cloud.x.end()),
+                *std::min_element(cloud.y.begin(), cloud.y.end()),
+                *std::min_element(cloud.z.begin(), cloud.z.end())};
+    }
+
+    /// @brief Ключи кубов всех точек, упорядоченные по ключу (точки куба идут подряд)
+    std::vector<Cell> cells(const VOXEL_TRANSFORM::Points &cloud, float spacing) {
+        const std::array<float, 3> origin = minimum(cloud);
+        const float scale = 1.0f / spacing;
+        std::vector<Cell> result(cloud.size());
+        PARALLEL::parallel_for((cloud.size() + BLOCK - 1) / BLOCK, [&](size_t b) {
+            const size_t end = std::min(cloud.size(), (b + 1) * BLOCK);
+            for(size_t i = b * BLOCK; i != end; ++i) {
+                uint64_t ix = std::min<uint64_t>(static_cast<uint64_t>((cloud.x[i] - origin[0]) * scale), KEY_MASK);
+                uint64_t iy = std::min<uint64_t>(static_cast<uint64_t>((cloud.y[i] - origin[1]) * scale), KEY_MASK);
+                uint64_t iz = std::min<uint64_t>(static_cast<uint64_t>((cloud.z[i] - origin[2]) * scale), KEY_MASK);
+                result[i] = {(ix << (2 * KEY_BITS)) | (iy << KEY_BITS) | iz, i};
+            }
+        });
+        // Устойчивый порядок внутри куба делает результат независимым от потоков
+        std::sort(result.begin(), result.end(), [](const Cell &a, const Cell &b) {
+            return a.key != b.key ? a.key < b.key : a.index < b.index;
+        });
+        return result;
+    }
+
+    size_t countCells(const VOXEL_TRANSFORM::Points &cloud, float spacing) {
+        std::vector<Cell> sorted = cells(cloud, spacing);
+        size_t count = 0;
+        for(size_t i = 0; i != sorted.size(); ++i)
+            if(i == 0 || sorted[i].key != sorted[i - 1].key)
+                ++count;
+        return count;
+    }
+}
+
+VOXEL_TRANSFORM::Points DECIMATION::voxelGrid(const VOXEL_TRANSFORM::Points &cloud, float spacing) {
+    VOXEL_TRANSFORM::Points result;
+    if(cloud.size() == 0 || spacing <= 0.0f)
+        return cloud;
+
+    std::vector<Cell> sorted = cells(cloud, spacing);
+    for(size_t begin = 0; begin != sorted.size();) {
+        size_t end = begin + 1;
+        while(end != sorted.size() && sorted[end].key == sorted[begin].key)
+            ++end;
+
+        // Центр масс точек куба
+        double cx = 0.0, cy = 0.0, cz = 0.0;
+        for(size_t i = begin; i != end; ++i) {
+            cx += cloud.x[sorted[i].index];
+            cy += cloud.y[sorted[i].index];
+            cz += cloud.z[sorted[i].index];
+        }
+        const double n = static_cast<double>(end - begin);
+        cx /= n;
+        cy /= n;
+        cz /= n;
+
+        // Остается исходная точка, ближайшая к центру масс
+        size_t best = sorted[begin].index;
+        double best_distance = -1.0;
+        for(size_t i = begin; i != end; ++i) {
+            const size_t k = sorted[i].index;
+            double dx = cloud.x[k] - cx, dy = cloud.y[k] - cy, dz = cloud.z[k] - cz;
+            double distance = dx * dx + dy * dy + dz * dz;
+            if(best_distance < 0.0 || distance < best_distance) {
+                best = k;
+                best_distance = distance;
+            }
+        }
+        result.x.push_back(cloud.x[best]);
+        result.y.push_back(cloud.y[best]);
+        result.z.push_back(cloud.z[best]);
+        begin = end;
+    }
+    return result;
+}
+
+float DECIMATION::spacingFor(const VOXEL_TRANSFORM::Points &cloud, size_t points) {
+    if(points == 0 || cloud.size() <= points)
+        return 0.0f;
+
+    // Начальное приближение: точки поверхности, распределенные по кубу габаритов
+    const std::array<float, 3> low = minimum(cloud);
+    const float dx = *std::max_element(cloud.x.begin(), cloud.x.end()) - low[0];
+    const float dy = *std::max_element(cloud.y.begin(), cloud.y.end()) - low[1];
+    const float dz = *std::max_element(cloud.z.begin(), cloud.z.end()) - low[2];
+    const double area = 2.0 * (dx * dy + dx * dz + dy * dz);
+    double spacing = std::max(1e-3, std::sqrt(area / points));
+
+    /// Для поверхности количество кубов обратно пропорционально квадрату шага
+    for(int iteration = 0; iteration != MAX_ITERATIONS; ++iteration) {
+        size_t count = countCells(cloud, static_cast<float>(spacing));
+        double ratio = static_cast<double>(count) / points;
+        if(std::abs(ratio - 1.0) <= COUNT_TOLERANCE)
+            break;
+        spacing *= std::sqrt(ratio);
+    }
+    return static_cast<float>(spacing);
+}
+
+VOXEL_TRANSFORM::Points DECIMATION::decimate(const VOXEL_TRANSFORM::Points &cloud, const Target &target) {
+    TRACE_SCOPE("decimate");
+    float spacing = target.spacing > 0.0f ? target.spacing : spacingFor(cloud, target.points);
+    if(spacing <= 0.0f)
+        return cloud;
+    return voxelGrid(cloud, spacing);
+}
@@ -0,0 +1,38 @@
+#ifndef DECIMATION_HPP
+#define DECIMATION_HPP
+
+#include "voxel_transform.hpp"
+#include <cstddef>
+
+
+/// Прореживание облака точек по сетке вокселов.
+/// Пространство делится на кубы с заданным шагом, от каждого занятого куба
+/// остается одна точка - ближайшая к центру масс точек куба (точка остается
+/// на поверхности). Плотность облака определяется шагом в миллиметрах,
+/// а не размером матрицы исследования, поэтому время реконструкции предсказуемо
+namespace DECIMATION {
+    /// Шаг сетки по умолчанию, мм
+    constexpr float DEFAULT_SPACING = 1.0f;
+
+    /// Требуемая плотность облака
+    struct Target {
+        float spacing = DEFAULT_SPACING;    /// Шаг сетки, мм (0 - подбирается по points)
+        size_t points = 0;                  /// Требуемое количество точек (при spacing == 0)
+    };
+
+    /// @brief Одна точка от каждого занятого куба сетки
+    /// @param cloud Исходное облако
+    /// @param spacing Шаг сетки, мм (больше нуля)
+    VOXEL_TRANSFORM::Points voxelGrid(const VOXEL_TRANSFORM::Points &cloud, float spacing);
+
+    /// @brief Подбирает шаг сетки, при котором остается примерно points точек
+    /// @return Шаг сетки или 0, если облако уже не больше points
+    float spacingFor(const VOXEL_TRANSFORM::Points &cloud, size_t points);
+
+    /// @brief Прореживание до требуемой плотности
+    /// @return Прореженное облако (копия исходного, если прореживать не нужно)
+    VOXEL_TRANSFORM::Points decimate(const VOXEL_TRANSFORM::Points &cloud, const Target &target);
+}
+
+
+#endif //DECIMATION_HPP
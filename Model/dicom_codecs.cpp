@@ -0,0 +1,23 @@
+#include "dicom_codecs.hpp"
+#include "dcmtk/dcmdata/dcrledrg.h"
+#include "dcmtk/dcmjpeg/djdecode.h"
+#include "dcmtk/dcmjpls/djdecode.h"
+
+
+DICOM_CODECS::Registration::Registration() {
+    DJDecoderRegistration::registerCodecs();
+    DJLSDecoderRegistration::registerCodecs();
+    DcmRLEDecoderRegistration::registerCodecs();
+}
+
+DICOM_CODECS::Registration::~Registration() {
+    DcmRLEDecoderRegistration::cleanup();
+    DJLSDecoderRegistration::cleanup();
+    DJDecoderRegistration::cleanup();
+}
+
+void DICOM_CODECS::ensureRegistered() {
+    /// Инициализация статического объекта потокобезопасна,
+    /// деструктор снимает регистрацию при выходе из программы
+    static Registration registration;
+}
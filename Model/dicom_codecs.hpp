@@ -0,0 +1,25 @@
+#ifndef DICOM_CODECS_HPP
+#define DICOM_CODECS_HPP
+
+
+/// Кодеки DCMTK для сжатых синтаксисов передачи (JPEG, JPEG-LS, RLE).
+/// Реестр кодеков глобален для процесса: регистрация и очистка не потокобезопасны
+/// и не должны выполняться вокруг каждого файла. Поэтому кодеки регистрируются
+/// один раз, до первого декодирования, и снимаются при завершении процесса.
+/// После регистрации декодирование разных файлов можно выполнять параллельно
+namespace DICOM_CODECS {
+    /// Владеет регистрацией декодеров (один объект на процесс)
+    class Registration {
+    public:
+        Registration();
+        ~Registration();
+        Registration(const Registration&) = delete;
+        Registration& operator=(const Registration&) = delete;
+    };
+
+    /// @brief Регистрирует декодеры при первом вызове (потокобезопасно)
+    void ensureRegistered();
+}
+
+
+#endif //DICOM_CODECS_HPP
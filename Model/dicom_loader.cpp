@@ -0,0 +1,335 @@
+#include "dicom_loader.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <map>
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double elapsed_ms(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    /// Меньше этого размера файл не может содержать заголовок и срез
+    constexpr std::uintmax_t MIN_FILE_SIZE = 256;
+    /// Сколько байт начала файла читается для проверки (преамбула и метаинформация)
+    constexpr size_t PROBE_SIZE = 1024;
+
+    /// Классы SOP объектов без срезов (префиксы UID)
+    const char *const NON_IMAGE_CLASSES[] = {
+        "1.2.840.10008.1.3.10",             // Media Storage Directory (DICOMDIR)
+        "1.2.840.10008.5.1.4.1.1.9.",       // Waveforms
+        "1.2.840.10008.5.1.4.1.1.11.",      // Presentation States
+        "1.2.840.10008.5.1.4.1.1.66",       // Raw Data, Registration, Segmentation
+        "1.2.840.10008.5.1.4.1.1.88.",      // Structured Reports, Key Object Selection
+        "1.2.840.10008.5.1.4.1.1.104.",     // Encapsulated PDF/CDA
+        "1.2.840.10008.5.1.4.1.1.481.",     // RT objects
+    };
+
+    uint16_t readUint16(const unsigned char *data) {
+        return static_cast<uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    uint32_t readUint32(const unsigned char *data) {
+        return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+             | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    /// @brief Ищет MediaStorageSOPClassUID (0002,0002) в метаинформации файла.
+    /// Метаинформация всегда в Explicit VR Little Endian
+    /// @param data Данные сразу после сигнатуры "DICM"
+    /// @return UID или пустая строка, если элемент не найден в прочитанной части
+    std::string metaSopClass(const unsigned char *data, size_t size) {
+        size_t pos = 0;
+        while(pos + 8 <= size) {
+            uint16_t group = readUint16(data + pos);
+            uint16_t element = readUint16(data + pos + 2);
+            if(group != 0x0002)
+                break;
+            std::string vr(reinterpret_cast<const char*>(data + pos + 4), 2);
+            size_t header = 8;
+            size_t length = readUint16(data + pos + 6);
+            if(vr == "OB" || vr == "OW" || vr == "OF" || vr == "SQ" || vr == "UT" || vr == "UN") {
+                if(pos + 12 > size)
+                    break;
+                header = 12;
+                length = readUint32(data + pos + 8);
+            }
+            if(element == 0x0002) {
+                if(pos + header + length > size)
+                    break;
+                std::string uid(reinterpret_cast<const char*>(data + pos + header), length);
+                while(!uid.empty() && (uid.back() == '\0' || uid.back() == ' '))
+                    uid.pop_back();
+                return uid;
+            }
+            pos += header + length;
+        }
+        return std::string();
+    }
+
+    bool isNonImageClass(const std::string &uid) {
+        for(const char *prefix: NON_IMAGE_CLASSES)
+            if(uid.compare(0, std::strlen(prefix), prefix) == 0)
+                return true;
+        return false;
+    }
+}
+
+std::vector<std::string> DICOM_LOADER::getPaths(const std::string &directory) {
+    TRACE_SCOPE("directory walk");
+    std::vector<std::string> paths;
+    for(const auto& entry: std::filesystem::recursive_directory_iterator(directory)) {
+        if(!entry.is_directory())
+            paths.emplace_back(entry.path().string());
+    }
+    // Порядок обхода директории не определен, сортируем для воспроизводимости
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+DICOM_LOADER::FileKind DICOM_LOADER::probeFile(const std::string &path) {
+    std::filesystem::path file_path(path);
+    if(file_path.filename() == "DICOMDIR")
+        return FileKind::NonImage;
+
+    std::error_code error;
+    std::uintmax_t size = std::filesystem::file_size(file_path, error);
+    if(error)
+        return FileKind::NotDicom;
+    if(size < MIN_FILE_SIZE)
+        return FileKind::TooSmall;
+
+    unsigned char buffer[PROBE_SIZE];
+    std::ifstream input(path, std::ios::binary);
+    input.read(reinterpret_cast<char*>(buffer), sizeof(buffer));
+    auto count = static_cast<size_t>(input.gcount());
+
+    /// Стандартный файл: 128 байт преамбулы и сигнатура "DICM"
+    if(count >= 132 && std::memcmp(buffer + 128, "DICM", 4) == 0)
+        return isNonImageClass(metaSopClass(buffer + 132, count - 132)) ? FileKind::NonImage
+                                                                        : FileKind::Image;
+
+    /// Файлы без преамбулы (ACR-NEMA, старые архивы) начинаются сразу с тегов
+    /// группы 0002 или 0008 в порядке little endian, такие DCMTK тоже читает
+    if(count >= 8 && buffer[1] == 0x00 && (buffer[0] == 0x02 || buffer[0] == 0x08))
+        return FileKind::Image;
+    return FileKind::NotDicom;
+}
+
+std::vector<std::string> DICOM_LOADER::findImages(const std::string &directory,
+                                                  unsigned threads,
+                                                  size_t *rejected) {
+    std::vector<std::string> paths = getPaths(directory);
+
+    /// Открытие файлов - основная цена обхода, поэтому проверки выполняются параллельно
+    TRACE_SCOPE("probe files");
+    std::vector<char> accepted(paths.size(), 0);
+    std::atomic<size_t> done(0);
+    PARALLEL::parallel_for(paths.size(), [&](size_t i) {
+        JOB::progress(static_cast<double>(done++) / paths.size(), "scan");
+        accepted[i] = probeFile(paths[i]) == FileKind::Image;
+    }, threads);
+
+    std::vector<std::string> images;
+    images.reserve(paths.size());
+    for(size_t i = 0; i != paths.size(); ++i)
+        if(accepted[i])
+            images.emplace_back(std::move(paths[i]));
+    if(rejected)
+        *rejected = paths.size() - images.size();
+    return images;
+}
+
+std::vector<DICOM_LOADER::Header> DICOM_LOADER::scanHeaders(const std::vector<std::string> &paths,
+                                                            unsigned threads) {
+    TRACE_SCOPE("scan headers");
+    std::vector<Header> headers(paths.size());
+    std::atomic<size_t> done(0);
+    PARALLEL::parallel_for(paths.size(), [&](size_t i) {
+        JOB::progress(static_cast<double>(done++) / paths.size(), "index");
+        Header &header = headers[i];
+        header.path = paths[i];
+        try {
+            DICOM dcm(paths[i], true);
+            auto size = dcm.extractSize();
+            header.rows = size.first;
+            header.cols = size.second;
+            // Файлы без изображения (DICOMDIR, отчеты) пропускаются
+            if(!header.rows || !header.cols)
+                return;
+            header.series_uid = dcm.extractSeriesUID();
+            header.research_type = dcm.extractResearchType();
+            header.position = dcm.extractPosition();
+            header.orientation = dcm.extractOrientation();
+            header.spaces = dcm.extractSpaces();
+            header.pixel_signed = dcm.extractPixelSigned();
+            header.rescale = dcm.extractRescale();
+            header.valid = true;
+        } catch(const std::exception &e) {
+            header.valid = false;
+        }
+    }, threads);
+    return headers;
+}
+
+DICOM_LOADER::StudyIndex DICOM_LOADER::buildIndex(std::vector<Header> headers) {
+    StudyIndex index;
+
+    /// Выбор серии с наибольшим количеством срезов
+    /// (при равенстве - той, что встречается раньше по порядку путей)
+    std::map<std::string, size_t> counts;
+    std::vector<std::string> first_seen;
+    for(auto &header: headers) {
+        if(!header.valid)
+            continue;
+        if(counts[header.series_uid]++ == 0)
+            first_seen.emplace_back(header.series_uid);
+    }
+    size_t best = 0;
+    for(auto &uid: first_seen) {
+        if(counts[uid] > best) {
+            best = counts[uid];
+            index.series_uid = uid;
+        }
+    }
+
+    /// Отбор файлов выбранной серии с размером первого ее среза
+    const Header *reference = nullptr;
+    for(auto &header: headers) {
+        if(!header.valid || header.series_uid != index.series_uid) {
+            index.skipped++;
+            continue;
+        }
+        if(!reference)
+            reference = &header;
+        if(header.rows != reference->rows || header.cols != reference->cols) {
+            index.skipped++;
+            continue;
+        }
+        index.files.emplace_back(header);
+    }
+    if(index.files.empty())
+        return index;
+
+    /// Сортировка по проекции положения на нормаль (как у vtkDICOMImageReader).
+    /// Срезы с совпадающим положением (повторы, другие эхо) в объем не попадают
+    std::vector<cv::Point3f> positions;
+    for(auto &file: index.files)
+        positions.emplace_back(file.position);
+    SLICE_ORDER::Order order = SLICE_ORDER::sort(positions, index.files[0].orientation);
+
+    std::vector<Header> sorted;
+    for(auto i: order.order)
+        sorted.emplace_back(std::move(index.files[i]));
+    index.files = std::move(sorted);
+    index.projections = std::move(order.projections);
+    index.duplicates = order.duplicates.size();
+    index.missing = order.missing;
+    index.skipped += index.duplicates;
+    if(order.spacing > 0.0f)
+        index.slice_spacing = order.spacing;
+    return index;
+}
+
+DICOM_LOADER::StudyIndex DICOM_LOADER::index(const std::string &directory, unsigned threads) {
+    auto start = Clock::now();
+    size_t rejected = 0;
+    std::vector<std::string> images = findImages(directory, threads, &rejected);
+    StudyIndex study_index = buildIndex(scanHeaders(images, threads));
+    study_index.skipped += rejected;
+    study_index.scan_ms = elapsed_ms(start);
+    std::cout << study_index.files.size() << " slices indexed in " << study_index.scan_ms << " ms ("
+              << study_index.skipped << " files skipped)" << std::endl;
+    if(study_index.duplicates)
+        std::cerr << "Warning: " << study_index.duplicates << " slices share a position with another slice"
+                  << " and were dropped" << std::endl;
+    if(study_index.missing)
+        std::cerr << "Warning: about " << study_index.missing << " slices are missing from the series" << std::endl;
+    return study_index;
+}
+
+DICOM_LOADER::Series DICOM_LOADER::load(const StudyIndex &index,
+                                        unsigned threads) {
+    std::vector<cv::Mat> targets(index.files.size());
+    Series series = load(index, targets, threads);
+
+    // Убираем нечитаемые файлы, сохраняя порядок
+    series.slices.erase(std::remove_if(series.slices.begin(), series.slices.end(),
+                                       [](const Slice &slice) { return !slice.valid; }),
+                        series.slices.end());
+    return series;
+}
+
+DICOM_LOADER::Series DICOM_LOADER::load(const StudyIndex &index,
+                                        std::vector<cv::Mat> &targets,
+                                        unsigned threads,
+                                        const std::string &stage) {
+    Series series;
+    series.threads = std::max(1u, std::min<unsigned>(threads, index.files.size()));
+    series.slices.resize(index.files.size());
+    if(index.files.empty())
+        return series;
+    if(targets.size() != index.files.size())
+        throw std::invalid_argument("number of target buffers does not match the index");
+
+    /// Общие параметры исследования уже известны из заголовков
+    const Header &first = index.files[0];
+    series.spaces = first.spaces;
+    series.orientation = first.orientation;
+    series.research_type = first.research_type;
+    series.pixel_signed = first.pixel_signed;
+    series.slice_spacing = index.slice_spacing;
+
+    TRACE_SCOPE("decode");
+    auto start = Clock::now();
+    std::atomic<size_t> done(0);
+    PARALLEL::parallel_for(index.files.size(), [&](size_t i) {
+        TRACE_SCOPE("decode slice");
+        JOB::progress(static_cast<double>(done++) / index.files.size(), stage);
+        auto file_start = Clock::now();
+        Slice &slice = series.slices[i];
+        slice.path = index.files[i].path;
+        slice.position = index.files[i].position;
+        try {
+            // Датасет живет только в пределах задачи: в памяти остается лишь буфер среза
+            DICOM dcm(slice.path);
+            slice.valid = dcm.extractImage(targets[i]);
+        } catch(const std::exception &e) {
+            std::cerr << "Error: cannot decode " << slice.path << " (" << e.what() << ")" << std::endl;
+        }
+        if(!slice.valid && !targets[i].empty())
+            targets[i].setTo(0);
+        slice.image = targets[i];
+        slice.decode_ms = elapsed_ms(file_start);
+    }, series.threads);
+    series.total_ms = elapsed_ms(start);
+    return series;
+}
+
+void DICOM_LOADER::printReport(const Series &series) {
+    if(series.slices.empty()) {
+        std::cout << "No DICOM files were loaded" << std::endl;
+        return;
+    }
+
+    double sum = 0;
+    double min = series.slices[0].decode_ms;
+    double max = min;
+    for(auto &slice: series.slices) {
+        sum += slice.decode_ms;
+        min = std::min(min, slice.decode_ms);
+        max = std::max(max, slice.decode_ms);
+    }
+
+    std::cout << series.slices.size() << " files was loaded in " << series.total_ms << " ms"
+              << " (" << series.threads << " threads)\n"
+              << "  per file: min " << min << " ms, avg " << sum / series.slices.size()
+              << " ms, max " << max << " ms\n"
+              << "  speedup over serial decode: " << sum / series.total_ms << std::endl;
+}
@@ -0,0 +1,125 @@
+#ifndef DICOM_LOADER_HPP
+#define DICOM_LOADER_HPP
+
+#include "parallel.hpp"
+#include "slice_order.hpp"
+#include "utility_dcm.hpp"
+
+
+namespace DICOM_LOADER {
+    /// Параметры файла, прочитанные из заголовка (без данных пикселей)
+    struct Header {
+        std::string             path;           /// Путь к файлу
+        std::string             series_uid;     /// SeriesInstanceUID
+        std::string             research_type;  /// Тип исследования (MR/CT)
+        cv::Point3f             position;       /// Положение среза в пространстве
+        std::array<float, 6>    orientation;    /// Ориентация среза (cos's)
+        std::pair<float, float> spaces;         /// Расстояния между пикселями
+        std::pair<float, float> rescale{1.0f, 0.0f}; /// RescaleSlope, RescaleIntercept
+        uint16_t                rows = 0;       /// Количество строк
+        uint16_t                cols = 0;       /// Количество столбцов
+        bool                    pixel_signed = false; /// Знаковые ли значения пикселей
+        bool                    valid = false;  /// Заголовок прочитан без ошибок
+    };
+
+    /// Индекс исследования: файлы одной серии, упорядоченные вдоль нормали к срезам
+    struct StudyIndex {
+        std::vector<Header>     files;          /// Файлы серии в порядке срезов
+        std::vector<float>      projections;    /// Проекции положений срезов на нормаль
+        std::string             series_uid;     /// Выбранная серия
+        float                   slice_spacing = 1.0f; /// Расстояние между срезами (медиана шагов)
+        size_t                  skipped = 0;    /// Отброшено файлов (не DICOM, другие серии, повторы)
+        size_t                  duplicates = 0; /// Срезов с повторяющимся положением
+        size_t                  missing = 0;    /// Оценка количества пропущенных срезов
+        double                  scan_ms = 0;    /// Время чтения заголовков
+    };
+
+    /// Один декодированный срез исследования
+    struct Slice {
+        std::string path;           /// Путь к файлу
+        cv::Mat     image;          /// Изображение среза (16 бит)
+        cv::Point3f position;       /// Положение среза в пространстве
+        double      decode_ms = 0;  /// Время чтения и декодирования файла
+        bool        valid = false;  /// Файл прочитан без ошибок
+    };
+
+    /// Результат загрузки директории
+    struct Series {
+        std::vector<Slice>      slices;         /// Срезы в порядке индекса
+        std::pair<float, float> spaces;         /// Расстояния между пикселями
+        std::array<float, 6>    orientation;    /// Ориентация срезов (cos's)
+        std::string             research_type;  /// Тип исследования (MR/CT)
+        bool                    pixel_signed = false; /// Знаковые ли значения пикселей
+        float                   slice_spacing = 1.0f; /// Расстояние между срезами
+        double                  total_ms = 0;   /// Общее время загрузки
+        unsigned                threads = 1;    /// Количество использованных потоков
+    };
+
+    /// Результат быстрой проверки файла (без разбора DCMTK)
+    enum class FileKind {
+        Image,      /// Похож на экземпляр DICOM с изображением
+        NotDicom,   /// Нет сигнатуры "DICM" и начало не похоже на DICOM без преамбулы
+        TooSmall,   /// Слишком мал, чтобы содержать срез
+        NonImage    /// DICOMDIR, отчеты, состояния представления и прочие объекты без срезов
+    };
+
+    /// @brief Собирает пути ко всем файлам директории (рекурсивно), отсортированные по имени
+    std::vector<std::string> getPaths(const std::string &directory);
+
+    /// @brief Проверяет файл по размеру, 128-байтной преамбуле с сигнатурой "DICM"
+    /// и классу SOP из метаинформации. Читается только начало файла
+    FileKind probeFile(const std::string &path);
+
+    /// @brief Собирает пути к срезам исследования: обходит директорию и параллельно
+    /// отбрасывает файлы, не являющиеся изображениями DICOM (probeFile)
+    /// @param directory Директория с исследованием
+    /// @param threads Количество рабочих потоков
+    /// @param rejected Если задан, сюда записывается количество отброшенных файлов
+    std::vector<std::string> findImages(const std::string &directory,
+                                        unsigned threads = PARALLEL::threads(),
+                                        size_t *rejected = nullptr);
+
+    /// @brief Параллельно читает только заголовки файлов (до данных пикселей)
+    /// @param paths Пути к файлам
+    /// @param threads Количество рабочих потоков
+    /// @return Заголовки в порядке путей, нечитаемые файлы помечены valid = false
+    std::vector<Header> scanHeaders(const std::vector<std::string> &paths,
+                                    unsigned threads = PARALLEL::threads());
+
+    /// @brief Строит индекс исследования по заголовкам: выбирает серию с наибольшим
+    /// числом срезов и упорядочивает ее файлы по проекции положения на нормаль к срезам
+    StudyIndex buildIndex(std::vector<Header> headers);
+
+    /// @brief Строит индекс исследования в директории
+    StudyIndex index(const std::string &directory,
+                     unsigned threads = PARALLEL::threads());
+
+    /// @brief Параллельно декодирует данные пикселей файлов индекса.
+    /// Каждый файл декодируется в заранее выделенную ячейку, поэтому порядок
+    /// срезов совпадает с порядком индекса и не зависит от числа потоков.
+    /// Нечитаемые файлы отбрасываются после загрузки
+    /// @param index Индекс исследования
+    /// @param threads Количество рабочих потоков
+    /// @return Загруженные срезы и общие параметры исследования
+    Series load(const StudyIndex &index,
+                unsigned threads = PARALLEL::threads());
+
+    /// @brief То же, но срезы декодируются прямо в буферы вызывающего.
+    /// targets[i] - заголовок CV_16UC1 размера среза (например, над участком
+    /// общего объема), slices[i].image ссылается на него же. Нечитаемые срезы
+    /// не отбрасываются, а заполняются нулями, чтобы не сдвигать буферы
+    /// @param index Индекс исследования
+    /// @param targets Буферы по одному на файл индекса
+    /// @param threads Количество рабочих потоков
+    /// @param stage Название этапа для JOB::progress
+    Series load(const StudyIndex &index,
+                std::vector<cv::Mat> &targets,
+                unsigned threads = PARALLEL::threads(),
+                const std::string &stage = "decode");
+
+    /// @brief Выводит статистику времени загрузки по файлам
+    void printReport(const Series &series);
+}
+
+
+#endif //DICOM_LOADER_HPP
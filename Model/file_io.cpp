@@ -0,0 +1,68 @@
+#include "file_io.hpp"
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+FILE_IO::Output::Output(const std::string &path): file(std::fopen(path.c_str(), "wb")), buffer(CHUNK) {}
+
+FILE_IO::Output::~Output() {
+    if(file)
+        std::fclose(file);
+}
+
+void FILE_IO::Output::append(const void *data, size_t bytes) {
+    if(size + bytes > buffer.size())
+        flush();
+    if(bytes > buffer.size()) {
+        write(data, bytes);
+        return;
+    }
+    std::memcpy(buffer.data() + size, data, bytes);
+    size += bytes;
+}
+
+void FILE_IO::Output::append(const char *text) {
+    append(text, std::strlen(text));
+}
+
+bool FILE_IO::Output::close() {
+    flush();
+    if(file && std::fclose(file) != 0)
+        ok = false;
+    file = nullptr;
+    return ok;
+}
+
+void FILE_IO::Output::flush() {
+    write(buffer.data(), size);
+    size = 0;
+}
+
+void FILE_IO::Output::write(const void *data, size_t bytes) {
+    if(file && bytes && std::fwrite(data, 1, bytes, file) != bytes)
+        ok = false;
+}
+
+FILE_IO::MappedFile::MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return;
+    struct stat st;
+    if(::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(ptr != MAP_FAILED) {
+            bytes = static_cast<const char*>(ptr);
+            length = static_cast<size_t>(st.st_size);
+            ::madvise(ptr, length, MADV_SEQUENTIAL);
+        }
+    }
+    ::close(fd);
+}
+
+FILE_IO::MappedFile::~MappedFile() {
+    if(bytes)
+        ::munmap(const_cast<char*>(bytes), length);
+}
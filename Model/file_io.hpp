@@ -0,0 +1,89 @@
+#ifndef FILE_IO_HPP
+#define FILE_IO_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+/// Общие средства быстрого файлового ввода-вывода для PLY, экспорта моделей и кэша:
+/// запись крупными порциями через один буфер и чтение через отображение в память (mmap)
+namespace FILE_IO {
+    /// Размер порции при записи
+    constexpr size_t CHUNK = 1 << 20;
+    /// Наибольшая длина записи через reserve()/commit()
+    constexpr size_t RESERVE = 256;
+
+    /// Файл для записи порциями: данные копятся в буфере и уходят одним fwrite
+    class Output {
+    public:
+        explicit Output(const std::string &path);
+        ~Output();
+        Output(const Output&) = delete;
+        Output& operator=(const Output&) = delete;
+
+        bool good() const { return file && ok; }
+
+        /// @brief Место под запись не длиннее RESERVE байт (после записи - commit)
+        char *reserve() {
+            if(size + RESERVE > buffer.size())
+                flush();
+            return buffer.data() + size;
+        }
+        void commit(char *end) {
+            size = static_cast<size_t>(end - buffer.data());
+        }
+
+        /// @brief Дописывает данные. Блоки крупнее буфера пишутся сразу, без копирования
+        void append(const void *data, size_t bytes);
+        void append(const char *text);
+        void append(const std::string &text) {
+            append(text.data(), text.size());
+        }
+
+        /// @brief Форматированный текст не длиннее RESERVE байт (snprintf)
+        template<typename... Args>
+        void print(const char *format, Args... args) {
+            char *out = reserve();
+            int length = std::snprintf(out, RESERVE, format, args...);
+            if(length > 0)
+                commit(out + std::min(static_cast<size_t>(length), RESERVE - 1));
+        }
+
+        /// @brief Дописывает буфер и закрывает файл
+        /// @return false, если что-то не записалось
+        bool close();
+
+    private:
+        void flush();
+        void write(const void *data, size_t bytes);
+
+    private:
+        std::FILE *file;
+        std::vector<char> buffer;
+        size_t size = 0;
+        bool ok = true;
+    };
+
+    /// Файл, отображенный в память только для чтения
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /// @brief Содержимое файла (nullptr, если файл не открыт или пуст)
+        const char *data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        const char *bytes = nullptr;
+        size_t length = 0;
+    };
+}
+
+
+#endif //FILE_IO_HPP
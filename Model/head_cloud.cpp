@@ -1,9 +1,42 @@
 #include "head_cloud.hpp"
+#include "decimation.hpp"
+#include "intensity.hpp"
+#include "ply_io.hpp"
+#include "segmentation.hpp"
+#include "slice_order.hpp"
+#include "trace.hpp"
+#include "voxel_transform.hpp"
+#include <climits>
+#include <numeric>
+
+
+namespace {
+    /// @brief Обход строк среза для векторных ядер: непрерывный срез - одна длинная строка
+    template<typename Func>
+    void forEachRow(const cv::Mat &image, Func &&func) {
+        if(image.isContinuous()) {
+            func(0, image.total());
+            return;
+        }
+        for(int row = 0; row != image.rows; ++row)
+            func(row, static_cast<size_t>(image.cols));
+    }
+
+    INTENSITY::Range sliceRange(const cv::Mat &image, bool is_signed) {
+        INTENSITY::Range result{INT_MAX, INT_MIN};
+        forEachRow(image, [&](int row, size_t count) {
+            INTENSITY::Range range = INTENSITY::range(image.ptr<uint16_t>(row), count, is_signed);
+            result.min = std::min(result.min, range.min);
+            result.max = std::max(result.max, range.max);
+        });
+        return result;
+    }
+}
 
 
 void HEAD_POINT_CLOUD::head_cloud_output(const std::string &directory_src,
                        const std::string &directory_dst) {
-    HeadCloud data(directory_src);
+    HeadCloud data(STUDY_VOLUME::read(directory_src));
     data.sort();
     data.equalizeImages();
     std::vector<cv::Point3f> cloud = data.headSurfaceCloud();
@@ -11,136 +44,113 @@ void HEAD_POINT_CLOUD::head_cloud_output(const std::string &directory_src,
 }
 
 std::vector<cv::Point3f> HEAD_POINT_CLOUD::head_cloud(const std::string &directory_src) {
-    HeadCloud data(directory_src);
+    return head_cloud(STUDY_VOLUME::read(directory_src));
+}
+
+std::vector<cv::Point3f> HEAD_POINT_CLOUD::head_cloud(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                                      const DECIMATION::Target &decimation) {
+    HeadCloud data(std::move(volume));
+    data.setDecimation(decimation);
     data.sort();
+    JOB::checkpoint();
     data.equalizeImages();
+    JOB::checkpoint();
     std::vector<cv::Point3f> cloud = data.headSurfaceCloud();
     return cloud;
 }
 
-HeadCloud::HeadCloud(const std::string &directory) {
-    std::vector<std::string> paths = getPaths(directory);
-    std::vector<DICOM> dcm_files;
-    for(auto & dcm_path: paths)
-        dcm_files.emplace_back(DICOM(dcm_path));
-    std::cout << dcm_files.size() << " files was found"  << std::endl;
+HEAD_POINT_CLOUD::HeadCloud::HeadCloud(std::shared_ptr<const STUDY_VOLUME::Volume> study): volume(std::move(study)) {
+    if(!volume)
+        throw std::runtime_error("empty study volume");
 
-    spaces = dcm_files[0].extractSpaces();
-    orientation = dcm_files[0].extractOrientation();
-    research_type = dcm_files[0].extractResearchType();
+    spaces = volume->spaces;
+    orientation = volume->orientation;
+    research_type = volume->research_type;
 
-    for(auto & dcm: dcm_files) {
-        images.emplace_back(dcm.extractImage());
-        positions.emplace_back(dcm.extractPosition());
-    }
+    // Заголовки ссылаются на пиксели объема, копирования нет
+    images = volume->slices;
+    positions = volume->positions;
+
+    // До sort() срезы обходятся в порядке объема
+    order.resize(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    slice_spacing = volume->slice_spacing;
 }
 
-std::vector<std::string> HeadCloud::getPaths(const std::string &directory) {
-    std::vector<std::string> paths;
-    for(const auto& entry: std::filesystem::recursive_directory_iterator(directory)) {
-        if(!entry.is_directory())
-            paths.emplace_back(entry.path().string());
-    }
-    return std::move(paths);
+void HEAD_POINT_CLOUD::HeadCloud::sort() {
+    TRACE_SCOPE("sort");
+    /// Сортируются только номера срезов по проекции положения на нормаль;
+    /// изображения и положения остаются на месте, порядок применяется при обходе
+    SLICE_ORDER::Order slice_order = SLICE_ORDER::sort(positions, orientation);
+    order = std::move(slice_order.order);
+    if(slice_order.spacing > 0.0f)
+        slice_spacing = slice_order.spacing;
+
+    if(!slice_order.duplicates.empty())
+        std::cerr << "Warning: " << slice_order.duplicates.size()
+                  << " slices share a position and are ignored" << std::endl;
+    if(slice_order.missing)
+        std::cerr << "Warning: about " << slice_order.missing << " slices are missing" << std::endl;
 }
 
-void HeadCloud::sort() {
-    /// Поиск минимального и максимального значения положения изображений исследования
-    float xmin = positions[0].x;
-    float ymin = positions[0].y;
-    float zmin = positions[0].z;
-    float xmax = xmin;
-    float ymax = ymin;
-    float zmax = zmin;
-
-    for(auto & position: positions) {
-        if(position.x < xmin)
-            xmin = position.x;
-        else if(position.x > xmax)
-            xmax = position.x;
-            
-        if(position.y < ymin)
-            ymin = position.y;
-        else if(position.y > ymax)
-            ymax = position.y;
-
-        if(position.z < zmin)
-            zmin = position.z;
-        else if(position.z > zmax)
-            zmax = position.z;
+void HEAD_POINT_CLOUD::HeadCloud::equalizeImages() {
+    if(images.empty())
+        return;
+    TRACE_SCOPE("equalize");
+    const bool is_signed = volume->pixel_signed;
+
+    /// Диапазон значений по всем срезам: срезы обрабатываются параллельно, затем сводятся
+    std::vector<INTENSITY::Range> ranges(images.size());
+    PARALLEL::parallel_for(images.size(), [&](size_t k) {
+        ranges[k] = sliceRange(images[k], is_signed);
+    });
+    INTENSITY::Range raw{INT_MAX, INT_MIN};
+    for(auto &range: ranges) {
+        raw.min = std::min(raw.min, range.min);
+        raw.max = std::max(raw.max, range.max);
     }
 
-    /// Поиск наибольшего смещения за исследование
-    float dx = xmax - xmin;
-    float dy = ymax - ymin;
-    float dz = zmax - zmin;
-
-    /// На основе наибольшего смещения определяется тип среза, 
-    /// а также создается мапа для сортировки
-    std::vector<float> order;
-    std::map<float, int> orderMap;
-    //Sagittal
-    if(dx > dy && dx > dz) {
-        int i = 0;
-        for(auto & position : positions) {
-            order.emplace_back(position.x);
-            orderMap[position.x] = i++;
-        }
-        std::sort(order.begin(), order.end(), std::greater<float>());
-    }
-    //Axial
-    else if(dy > dx && dy > dz) {
-        int i = 0;
-        for(auto & position: positions) {
-            order.emplace_back(position.y);
-            orderMap[position.y] = i++;
-        }
-        std::sort(order.begin(), order.end(), std::less<float>());
-    }
-    //Coronal
-    else if(dz > dy && dz > dx) {
-        int i = 0;
-        for(auto & position: positions) {
-            order.emplace_back(position.z);
-            orderMap[position.z] = i++;
-        }
-        std::sort(order.begin(), order.end(), std::less<float>());
+    /// Окно считается в единицах модальности (value * slope + intercept, для КТ - HU).
+    /// Нижняя граница - уровень воздуха: все, что ниже (заполнение вне поля обзора),
+    /// становится нулем. Поэтому пороги следующих этапов не зависят от того, как
+    /// аппарат хранит значения - со знаком или со сдвигом
+    const float slope = volume->rescale_slope;
+    const float intercept = volume->rescale_intercept;
+    float low = raw.min * slope + intercept;
+    float high = raw.max * slope + intercept;
+    if(low > high)
+        std::swap(low, high);
+    low = std::max(low, research_type == "CT" ? -1024.0f : 0.0f);
+
+    /// Перевод в 8 бит одним линейным преобразованием исходных значений.
+    /// Пустой диапазон (темное исследование) дает черные срезы, а не деление на ноль
+    float scale = 0.0f;
+    float offset = 0.0f;
+    if(high > low) {
+        float k = 255.0f / (high - low);
+        scale = slope * k;
+        offset = (intercept - low) * k;
+    } else {
+        std::cerr << "Warning: study has an empty intensity range" << std::endl;
     }
 
-    /// Сортировка
-    std::vector<cv::Mat> new_images;
-    std::vector<cv::Point3f> new_positions;
-    for(auto &i: order) {
-        new_images.emplace_back(images[orderMap[i]]);
-        new_positions.emplace_back(positions[orderMap[i]]);
-    }
-    this->images = new_images;
-    this->positions = new_positions;
+    std::vector<cv::Mat> equalized(images.size());
+    PARALLEL::parallel_for(images.size(), [&](size_t k) {
+        const cv::Mat &image = images[k];
+        equalized[k].create(image.rows, image.cols, CV_8UC1);
+        forEachRow(image, [&](int row, size_t count) {
+            INTENSITY::rescale(image.ptr<uint16_t>(row), equalized[k].ptr<uint8_t>(row),
+                               count, is_signed, scale, offset);
+        });
+    });
+    images = std::move(equalized);
 }
 
-void HeadCloud::equalizeImages() {
-    int16_t maxVal = 0;
-    // находим максимальную интенсивность среди всех изображений
-    for(auto &image: images)
-        for(int i = 0; i != image.rows; i++)
-            for(int j = 0; j != image.cols; j++)
-                if(image.at<int16_t>(i, j) > maxVal)
-                    maxVal = image.at<int16_t>(i, j);
-
-    /// Находим делитель для перевода в 8 бит
-    auto divider = (int16_t)(maxVal / 255);
-
-    /// Применяем его
-    for(auto &image: images) {
-        cv::Mat newMat(image.rows, image.cols, CV_8UC1);
-        for(int i = 0; i != image.rows; i++)
-            for(int j = 0; j != image.cols; j++)
-                newMat.at<uint8_t>(i, j) = static_cast<uint8_t>(image.at<uint16_t>(i, j) / divider);
-        image = newMat;
-    }
+std::vector<cv::Point3f> HEAD_POINT_CLOUD::HeadCloud::headSurfaceCloud() {
+    return headSurfacePoints().toPoint3f();
 }
 
-std::vector<cv::Point3f> HeadCloud::headSurfaceCloud() {
+VOXEL_TRANSFORM::Points HEAD_POINT_CLOUD::HeadCloud::headSurfacePoints() {
     uint8_t threshold = defineThreshold();
     std::vector<cv::Mat> contours = headSurfaceContours(threshold);
 
@@ -152,51 +162,34 @@ std::vector<cv::Point3f> HeadCloud::headSurfaceCloud() {
         cv::waitKey(0);
     }*/
 
-    // инициализация матриц для вычисления координат точек
-    cv::Mat A(4, 4, CV_32FC1);
-    cv::Mat B(4, 1, CV_32FC1);
-    A.at<float>(0, 2) = 0;
-    A.at<float>(1, 2) = 0;
-    A.at<float>(2, 2) = 0;
-    A.at<float>(3, 2) = 0;
-    A.at<float>(3, 0) = 0;
-    A.at<float>(3, 1) = 0;
-    A.at<float>(3, 3) = 1;
-    B.at<float>(0, 2) = 0;
-    B.at<float>(0, 3) = 1;
-    A.at<float>(0, 0) = orientation[0] * spaces.first;
-    A.at<float>(1, 0) = orientation[1] * spaces.first;
-    A.at<float>(2, 0) = orientation[2] * spaces.first;
-    A.at<float>(0, 1) = orientation[3] * spaces.second;
-    A.at<float>(1, 1) = orientation[4] * spaces.second;
-    A.at<float>(2, 1) = orientation[5] * spaces.second;
-
-    std::vector<cv::Point3f> surface_cloud;
-    for(size_t i = 0; i != contours.size(); ++i) {
-        A.at<float>(0, 3) = positions[i].x; 
-        A.at<float>(1, 3) = positions[i].y;
-        A.at<float>(2, 3) = positions[i].z;
-        for(int row = 0; row != contours[i].rows; ++row) {
-            for(int col = 0; col != contours[i].cols; ++col) {
-                // Если в данном пикселе контура нет - заносить в облако точек не надо
-                if(!contours[i].at<uint8_t>(row, col))
-                    continue;
-                
-                /// Конечная инициализация матрицы
-                B.at<float>(0, 0) = (float)col;
-                B.at<float>(0, 1) = (float)row;
-                cv::Mat res = A * B;
-
-                // Создание новой точки и запись ее в облако
-                cv::Point3f tmp(res.at<float>(0, 0), res.at<float>(0, 1), res.at<float>(0, 2));
-                surface_cloud.emplace_back(tmp);
-            }
-        }
-    }
-    return surface_cloud;
+    TRACE_SCOPE("cloud");
+    // Количество точек каждого среза известно заранее: буфер выделяется один раз,
+    // а срез пишет в свой участок, поэтому порядок точек не зависит от потоков
+    std::vector<size_t> offsets(contours.size() + 1, 0);
+    PARALLEL::parallel_for(contours.size(), [&](size_t i) {
+        offsets[i + 1] = static_cast<size_t>(cv::countNonZero(contours[i]));
+    });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    VOXEL_TRANSFORM::Points surface_cloud;
+    surface_cloud.resize(offsets.back());
+    PARALLEL::parallel_for(contours.size(), [&](size_t i) {
+        thread_local std::vector<cv::Point> pixels;
+        // Координаты пикселей контура (строка за строкой, как и при обходе матрицы)
+        cv::findNonZero(contours[i], pixels);
+        // contours[i] построен по срезу order[i]
+        VOXEL_TRANSFORM::Affine affine = VOXEL_TRANSFORM::sliceAffine(orientation, spaces, positions[order[i]]);
+        const size_t offset = offsets[i];
+        VOXEL_TRANSFORM::transform(affine, pixels.data(), pixels.size(),
+                                   surface_cloud.x.data() + offset,
+                                   surface_cloud.y.data() + offset,
+                                   surface_cloud.z.data() + offset);
+    });
+    // Плотность облака задается в миллиметрах и не зависит от размера матрицы
+    return DECIMATION::decimate(surface_cloud, decimation);
 }
 
-uint8_t HeadCloud::defineThreshold() {
+uint8_t HEAD_POINT_CLOUD::HeadCloud::defineThreshold() {
     if(research_type == "CT") {
         return 40;
     } else {
@@ -205,19 +198,20 @@ uint8_t HeadCloud::defineThreshold() {
     }
 }
 
-std::vector<int> HeadCloud::buildHistogram() {
+std::vector<int> HEAD_POINT_CLOUD::HeadCloud::buildHistogram() {
     // Гистограмма для определения пороговых значений
     std::vector<int> histogram(256, 0);
 
     // Подсчет количества пикселей каждой интенсивности
-    for(auto &image: images) {
+    for(size_t k: order) {
+        const cv::Mat &image = images[k];
         for(auto pixel = image.datastart ; pixel != image.dataend; pixel++)
             histogram[*pixel]++;
     }
     return histogram;
 }
 
-uint8_t HeadCloud::histogramThreshold(std::vector<int> &histogram) {
+uint8_t HEAD_POINT_CLOUD::HeadCloud::histogramThreshold(std::vector<int> &histogram) {
     /// Общее количество пикселей на всех изображениях
     int numberOfPixels = 0;
     for(auto &pixels : histogram)
@@ -244,42 +238,52 @@ uint8_t HeadCloud::histogramThreshold(std::vector<int> &histogram) {
     return t;
 }
 
-std::vector<cv::Mat> HeadCloud::headSurfaceContours(uint8_t threshold) {
-    int g_kernel, g_sigma;
-    gaussianKernel(g_kernel, g_sigma);
+SEGMENTATION::Mask HEAD_POINT_CLOUD::HeadCloud::headMask() {
+    return headMask(defineThreshold());
+}
 
-    std::vector<cv::Mat> masks;
-    if(research_type == "CT") {
-        for(auto &image: images)
-            masks.emplace_back(maskCT(image, threshold, g_kernel, g_sigma));
-    } else {
-        for(auto &image: images)
-            masks.emplace_back(maskMRI(image, threshold, g_kernel, g_sigma));
-    }
+SEGMENTATION::Mask HEAD_POINT_CLOUD::HeadCloud::headMask(uint8_t threshold) {
+    TRACE_SCOPE("mask");
+    SEGMENTATION::Parameters parameters;
+    parameters.ct = research_type == "CT";
+    parameters.threshold = threshold;
+    if(!images.empty())
+        gaussianKernel(parameters.g_kernel, parameters.g_sigma);
+    parameters.pixel_spacing = spaces.first;
+    parameters.slice_spacing = slice_spacing;
+    return SEGMENTATION::segment(images, order, parameters);
+}
 
-    std::vector<cv::Mat> head_surface_contours;
-    for(auto &mask: masks) {
-        // поиск списка контуров на маске
-        std::vector<std::vector<cv::Point>> contours;
-        std::vector<cv::Vec4i> hierarchy;
-        cv::findContours(mask, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_NONE);
-        
-        // прорисовка всех контуров
-        cv::Mat head_contour = cv::Mat::zeros(mask.rows, mask.cols, CV_8UC1);
-        for(int i = 0; i != contours.size(); i++)
-            cv::drawContours(head_contour, contours, i, 255, 1, cv::LINE_8, hierarchy);
-        head_surface_contours.emplace_back(head_contour);
-    }
+VOXEL_TRANSFORM::Affine HEAD_POINT_CLOUD::HeadCloud::maskAffine() const {
+    cv::Point3f first = order.empty() ? cv::Point3f() : positions[order[0]];
+    return VOXEL_TRANSFORM::volumeAffine(orientation, spaces, first, slice_spacing);
+}
 
-    // Небольшая децимация точек в контуре
-    cv::Mat lattice = createLattice(masks[0].rows, masks[0].cols);
-    for(auto &contour: head_surface_contours)
-        cv::bitwise_and(contour, lattice, contour);
-    
+std::vector<cv::Mat> HEAD_POINT_CLOUD::HeadCloud::headSurfaceContours(uint8_t threshold) {
+    std::vector<cv::Mat> head_surface_contours(order.size());
+    if(order.empty())
+        return head_surface_contours;
+
+    /// Маска строится сразу по всему объему, срез i маски - это срез order[i]
+    const SEGMENTATION::Mask mask = headMask(threshold);
+    TRACE_SCOPE("contour");
+    /// Срезы независимы: контуры считаются параллельно,
+    /// промежуточные буферы каждого потока переиспользуются между срезами
+    PARALLEL::parallel_for(order.size(), [&](size_t i) {
+        thread_local ContourScratch scratch;
+        // поиск списка контуров на маске (маска не изменяется)
+        cv::findContours(mask.slice(i), scratch.contours, scratch.hierarchy,
+                         cv::RETR_TREE, cv::CHAIN_APPROX_NONE);
+
+        // прорисовка всех контуров за один вызов
+        cv::Mat head_contour = cv::Mat::zeros(mask.rows, mask.cols, CV_8UC1);
+        cv::drawContours(head_contour, scratch.contours, -1, 255, 1, cv::LINE_8, scratch.hierarchy);
+        head_surface_contours[i] = head_contour;
+    });
     return head_surface_contours;
 }
 
-void HeadCloud::gaussianKernel(int &g_kernel, int &g_sigma) {
+void HEAD_POINT_CLOUD::HeadCloud::gaussianKernel(int &g_kernel, int &g_sigma) {
     float scale_X = images[0].cols / 256.0f;
     float scale_Y = images[0].rows / 256.0f;
     float scale_f = (scale_X + scale_Y) / 2.0f;
@@ -293,80 +297,10 @@ void HeadCloud::gaussianKernel(int &g_kernel, int &g_sigma) {
         g_sigma -= 1;
 }
 
-cv::Mat HeadCloud::maskCT(cv::Mat &image, uint8_t threshold, int g_kernel, int g_sigma) {
-    // Делаем копию, чтоб не повредить исходник
-    cv::Mat tmp = image.clone();
-    // Убираем шумы и дефекты изображения
-    cv::GaussianBlur(tmp, tmp, cv::Size(7, 7), 5);
-    // Убираем все, что ниже проницаемости скальпа (кожи головы)
-    cv::threshold(tmp, tmp, threshold, 255, cv::THRESH_BINARY);
-    // Заливка всего, что вокруг головы
-    cv::Mat floodFill = tmp.clone();
-    cv::floodFill(floodFill, cv::Point(0, 0), cv::Scalar(255));
-    // Инвариация. Выделение незаполненых полостей внутри головы
-    cv::Mat tmp_inv;
-    bitwise_not(floodFill, tmp_inv);
-    // Заливка незаполненных полостей
-    cv::Mat out = (tmp | tmp_inv);
-    return out;
-}
-
-cv::Mat HeadCloud::maskMRI(cv::Mat &image, uint8_t threshold, int g_kernel, int g_sigma) {
-    // Делаем копию, чтоб не повредить исходник
-    cv::Mat tmp = image.clone();
-    // Предварительная чистка шумов
-    cv::threshold(tmp, tmp, threshold, 255, cv::THRESH_TOZERO);
-    // Убираем оставшиеся шумы и дефекты изображения
-    cv::GaussianBlur(tmp, tmp, cv::Size(g_kernel, g_kernel), g_sigma);
-    // Убираем все, что ниже магнитной проницаемости скальпа (кожи головы)
-    cv::threshold(tmp, tmp, threshold, 255, cv::THRESH_BINARY);
-    // Морфологическая операция для замыкания маски для правильной заливки
-    int kernel_size = image.cols / 40;
-    cv::dilate(tmp, tmp, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(kernel_size, kernel_size)));
-    cv::erode(tmp, tmp, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(kernel_size, kernel_size)));
-    // Заливка всего, что вокруг головы
-    cv::Mat floodFill = tmp.clone();
-    cv::floodFill(floodFill, cv::Point(0, 0), cv::Scalar(255));
-    // Инвариация. Выделение незаполненых полостей внутри головы
-    cv::Mat tmp_inv;
-    bitwise_not(floodFill, tmp_inv);
-    // Заливка незаполненных полостей
-    cv::Mat out = (tmp | tmp_inv);
-    // Уменьшение границ, размазанных гауссовым фильтром
-    cv::erode(out, out, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(g_sigma, g_sigma)));
-    return out;
-}
-
-cv::Mat HeadCloud::createLattice(int rows, int cols) {
-    cv::Mat lattice = cv::Mat::zeros(rows, cols, CV_8UC1);
-
-    for(int x = 0; x != lattice.cols; ++x)
-        for(int y = 1; y < lattice.rows; y += 2) 
-            lattice.at<uint8_t>(y,x) = 255;
-
-    for(int x = 1; x < lattice.cols; x += 2)
-        for(int y = 0; y != lattice.rows; ++y)
-            lattice.at<uint8_t>(y,x) = 255;
-        
-    return lattice;
-}
-
-void HeadCloud::saveCloudPLY(std::vector<cv::Point3f> &cloud,
-                             const std::string &directory) {
+void HEAD_POINT_CLOUD::HeadCloud::saveCloudPLY(std::vector<cv::Point3f> &cloud,
+                             const std::string &directory,
+                             PLY_IO::Format format) {
     std::cout << "Saving to PLY" << std::endl;
     std::string filename = "cloud";
-    std::ofstream output_file(directory + "/" + filename + ".ply");
-
-    output_file << "ply\n";
-    output_file << "format ascii 1.0\n";
-    output_file << "element vertex " << cloud.size() << "\n";
-    output_file << "property float32 x\n";
-    output_file << "property float32 y\n";
-    output_file << "property float32 z\n";
-    output_file << "element face " << 0 << "\n";
-    output_file << "property list uint8 int32 vertex_indices\n";
-    output_file << "end_header\n";
-
-    for(auto &point: cloud)
-        output_file << point.x << " " << point.y << " " << point.z << "\n";
+    PLY_IO::writeCloud(directory + "/" + filename + ".ply", cloud, format);
 }
@@ -2,40 +2,68 @@
 #define HEAD_CLOUD_HPP
 
 #include <filesystem>
-#include "utility_dcm.hpp"
+#include "decimation.hpp"
+#include "ply_io.hpp"
+#include "segmentation.hpp"
+#include "study_volume.hpp"
+#include "voxel_transform.hpp"
 
 namespace HEAD_POINT_CLOUD {
     void head_cloud_output(const std::string &directory_src,
                        const std::string &directory_dst);
     std::vector<cv::Point3f> head_cloud(const std::string &directory_src);
-}
+    /// @brief Строит облако точек поверхности головы по уже прочитанному объему
+    /// @param decimation Плотность облака (шаг сетки или количество точек)
+    std::vector<cv::Point3f> head_cloud(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                        const DECIMATION::Target &decimation = DECIMATION::Target());
 
-namespace {
+    /// Этапы построения облака по отдельности (для замеров и отладки)
     class HeadCloud {
     public:
-        HeadCloud(const std::string &directory);
+        HeadCloud(std::shared_ptr<const STUDY_VOLUME::Volume> study);
     public:
+        /// Упорядочивает срезы вдоль нормали (перестановкой номеров, без копирования)
         void sort();
+        /// Номера срезов в порядке вдоль нормали, без повторов
+        const std::vector<size_t> &sliceOrder() const { return order; }
+        /// Расстояние между соседними срезами
+        float sliceSpacing() const { return slice_spacing; }
         void equalizeImages();
+        /// Плотность облака точек поверхности (по умолчанию DECIMATION::DEFAULT_SPACING)
+        void setDecimation(const DECIMATION::Target &target) { decimation = target; }
         std::vector<cv::Point3f> headSurfaceCloud();
+        /// @brief Облако точек поверхности в виде структуры массивов
+        VOXEL_TRANSFORM::Points headSurfacePoints();
+        /// @brief Бинарная маска головы по всему объему (срезы в порядке sliceOrder())
+        SEGMENTATION::Mask headMask();
+        /// @brief Перевод индексов вокселов маски в координаты пациента (после sort())
+        VOXEL_TRANSFORM::Affine maskAffine() const;
         void saveCloudPLY(std::vector<cv::Point3f> &cloud,
-                          const std::string &directory);
+                          const std::string &directory,
+                          PLY_IO::Format format = PLY_IO::defaultFormat());
+    private:
+        /// Рабочие буферы потока: переиспользуются от среза к срезу
+        struct ContourScratch {
+            std::vector<std::vector<cv::Point>> contours;
+            std::vector<cv::Vec4i> hierarchy;
+        };
     private:
-        std::vector<std::string> getPaths(const std::string &directory);
         uint8_t defineThreshold();
         std::vector<int> buildHistogram();
         uint8_t histogramThreshold(std::vector<int> &histogram);
         std::vector<cv::Mat> headSurfaceContours(uint8_t threshold);
         void gaussianKernel(int &g_kernel, int &g_sigma);
-        cv::Mat maskCT(cv::Mat &image, uint8_t threshold, int g_kernel, int g_sigma);
-        cv::Mat maskMRI(cv::Mat &image, uint8_t threshold, int g_kernel, int g_sigma);
-        cv::Mat createLattice(int rows, int cols);
+        SEGMENTATION::Mask headMask(uint8_t threshold);
     private:
+        std::shared_ptr<const STUDY_VOLUME::Volume> volume;
         std::vector<cv::Mat> images;
         std::vector<cv::Point3f> positions;
+        std::vector<size_t> order;
+        float slice_spacing = 1.0f;
         std::pair<float, float> spaces;
         std::array<float, 6> orientation;
         std::string research_type;
+        DECIMATION::Target decimation;
 };
 }
 
@@ -0,0 +1,207 @@
+#include "intensity.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define INTENSITY_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+    enum class Isa { Scalar, SSE41, AVX2 };
+
+    Isa detectIsa() {
+#ifdef INTENSITY_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if(__builtin_cpu_supports("sse4.1"))
+            return Isa::SSE41;
+#endif
+        return Isa::Scalar;
+    }
+
+    Isa isa() {
+        static const Isa value = detectIsa();
+        return value;
+    }
+
+    /// Скалярные версии, ими же обрабатываются хвосты векторных
+    template<typename T>
+    INTENSITY::Range rangeScalar(const T *data, size_t count, INTENSITY::Range range) {
+        for(size_t i = 0; i != count; ++i) {
+            range.min = std::min<int>(range.min, data[i]);
+            range.max = std::max<int>(range.max, data[i]);
+        }
+        return range;
+    }
+
+    template<typename T>
+    void rescaleScalar(const T *src, uint8_t *dst, size_t count, float scale, float offset) {
+        for(size_t i = 0; i != count; ++i) {
+            // Округление к ближайшему четному, как у cvtps_epi32
+            float value = std::nearbyint(static_cast<float>(src[i]) * scale + offset);
+            dst[i] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, value)));
+        }
+    }
+
+    INTENSITY::Range initialRange() {
+        return {std::numeric_limits<int>::max(), std::numeric_limits<int>::min()};
+    }
+
+#ifdef INTENSITY_X86
+    __attribute__((target("avx2")))
+    INTENSITY::Range rangeAVX2(const uint16_t *data, size_t count, bool is_signed) {
+        size_t vector_count = count / 16 * 16;
+        INTENSITY::Range range = initialRange();
+        if(vector_count) {
+            __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+            __m256i vmin = first, vmax = first;
+            for(size_t i = 16; i != vector_count; i += 16) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                if(is_signed) {
+                    vmin = _mm256_min_epi16(vmin, v);
+                    vmax = _mm256_max_epi16(vmax, v);
+                } else {
+                    vmin = _mm256_min_epu16(vmin, v);
+                    vmax = _mm256_max_epu16(vmax, v);
+                }
+            }
+            alignas(32) uint16_t lanes_min[16], lanes_max[16];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes_min), vmin);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes_max), vmax);
+            if(is_signed) {
+                range = rangeScalar(reinterpret_cast<const int16_t*>(lanes_min), 16, range);
+                range = rangeScalar(reinterpret_cast<const int16_t*>(lanes_max), 16, range);
+            } else {
+                range = rangeScalar(lanes_min, 16, range);
+                range = rangeScalar(lanes_max, 16, range);
+            }
+        }
+        if(is_signed)
+            return rangeScalar(reinterpret_cast<const int16_t*>(data) + vector_count, count - vector_count, range);
+        return rangeScalar(data + vector_count, count - vector_count, range);
+    }
+
+    __attribute__((target("sse4.1")))
+    INTENSITY::Range rangeSSE41(const uint16_t *data, size_t count, bool is_signed) {
+        size_t vector_count = count / 8 * 8;
+        INTENSITY::Range range = initialRange();
+        if(vector_count) {
+            __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            __m128i vmin = first, vmax = first;
+            for(size_t i = 8; i != vector_count; i += 8) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                if(is_signed) {
+                    vmin = _mm_min_epi16(vmin, v);
+                    vmax = _mm_max_epi16(vmax, v);
+                } else {
+                    vmin = _mm_min_epu16(vmin, v);
+                    vmax = _mm_max_epu16(vmax, v);
+                }
+            }
+            alignas(16) uint16_t lanes_min[8], lanes_max[8];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes_min), vmin);
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes_max), vmax);
+            if(is_signed) {
+                range = rangeScalar(reinterpret_cast<const int16_t*>(lanes_min), 8, range);
+                range = rangeScalar(reinterpret_cast<const int16_t*>(lanes_max), 8, range);
+            } else {
+                range = rangeScalar(lanes_min, 8, range);
+                range = rangeScalar(lanes_max, 8, range);
+            }
+        }
+        if(is_signed)
+            return rangeScalar(reinterpret_cast<const int16_t*>(data) + vector_count, count - vector_count, range);
+        return rangeScalar(data + vector_count, count - vector_count, range);
+    }
+
+    __attribute__((target("avx2")))
+    void rescaleAVX2(const uint16_t *src, uint8_t *dst, size_t count,
+                     bool is_signed, float scale, float offset) {
+        size_t vector_count = count / 16 * 16;
+        const __m256 vscale = _mm256_set1_ps(scale);
+        const __m256 voffset = _mm256_set1_ps(offset);
+        for(size_t i = 0; i != vector_count; i += 16) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+            __m256i lo32 = is_signed ? _mm256_cvtepi16_epi32(lo) : _mm256_cvtepu16_epi32(lo);
+            __m256i hi32 = is_signed ? _mm256_cvtepi16_epi32(hi) : _mm256_cvtepu16_epi32(hi);
+            // Умножение и сложение раздельно (без FMA), как в скалярной версии
+            __m256 flo = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(lo32), vscale), voffset);
+            __m256 fhi = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(hi32), vscale), voffset);
+            // Насыщение до int16, затем до uint8; packs работает внутри 128-битных половин
+            __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(flo), _mm256_cvtps_epi32(fhi));
+            packed = _mm256_permute4x64_epi64(packed, 0xD8);
+            __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                             _mm256_extracti128_si256(packed, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+        }
+        if(is_signed)
+            rescaleScalar(reinterpret_cast<const int16_t*>(src) + vector_count, dst + vector_count,
+                          count - vector_count, scale, offset);
+        else
+            rescaleScalar(src + vector_count, dst + vector_count, count - vector_count, scale, offset);
+    }
+
+    __attribute__((target("sse4.1")))
+    void rescaleSSE41(const uint16_t *src, uint8_t *dst, size_t count,
+                      bool is_signed, float scale, float offset) {
+        size_t vector_count = count / 8 * 8;
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 voffset = _mm_set1_ps(offset);
+        for(size_t i = 0; i != vector_count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i lo32 = is_signed ? _mm_cvtepi16_epi32(v) : _mm_cvtepu16_epi32(v);
+            __m128i hi32 = is_signed ? _mm_cvtepi16_epi32(_mm_srli_si128(v, 8))
+                                     : _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+            __m128 flo = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo32), vscale), voffset);
+            __m128 fhi = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi32), vscale), voffset);
+            __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(flo), _mm_cvtps_epi32(fhi));
+            __m128i bytes = _mm_packus_epi16(words, words);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), bytes);
+        }
+        if(is_signed)
+            rescaleScalar(reinterpret_cast<const int16_t*>(src) + vector_count, dst + vector_count,
+                          count - vector_count, scale, offset);
+        else
+            rescaleScalar(src + vector_count, dst + vector_count, count - vector_count, scale, offset);
+    }
+#endif
+}
+
+std::string INTENSITY::implementation() {
+    switch(isa()) {
+        case Isa::AVX2:  return "avx2";
+        case Isa::SSE41: return "sse4.1";
+        default:         return "scalar";
+    }
+}
+
+INTENSITY::Range INTENSITY::range(const uint16_t *data, size_t count, bool is_signed) {
+#ifdef INTENSITY_X86
+    if(isa() == Isa::AVX2)
+        return rangeAVX2(data, count, is_signed);
+    if(isa() == Isa::SSE41)
+        return rangeSSE41(data, count, is_signed);
+#endif
+    if(is_signed)
+        return rangeScalar(reinterpret_cast<const int16_t*>(data), count, initialRange());
+    return rangeScalar(data, count, initialRange());
+}
+
+void INTENSITY::rescale(const uint16_t *src, uint8_t *dst, size_t count,
+                        bool is_signed, float scale, float offset) {
+#ifdef INTENSITY_X86
+    if(isa() == Isa::AVX2)
+        return rescaleAVX2(src, dst, count, is_signed, scale, offset);
+    if(isa() == Isa::SSE41)
+        return rescaleSSE41(src, dst, count, is_signed, scale, offset);
+#endif
+    if(is_signed)
+        rescaleScalar(reinterpret_cast<const int16_t*>(src), dst, count, scale, offset);
+    else
+        rescaleScalar(src, dst, count, scale, offset);
+}
@@ -0,0 +1,38 @@
+#ifndef INTENSITY_HPP
+#define INTENSITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/// Векторные ядра для работы с 16-битными значениями срезов.
+/// Реализация (AVX2, SSE4.1 или скалярная) выбирается один раз при первом вызове
+/// по возможностям процессора; результаты всех реализаций совпадают побитно
+namespace INTENSITY {
+    /// Диапазон значений (в исходных единицах, со знаком или без)
+    struct Range {
+        int min;
+        int max;
+    };
+
+    /// @brief Название выбранной реализации (avx2, sse4.1, scalar)
+    std::string implementation();
+
+    /// @brief Минимум и максимум значений
+    /// @param data Значения (int16 или uint16 в зависимости от is_signed)
+    /// @param count Количество значений (больше нуля)
+    /// @param is_signed Значения знаковые
+    Range range(const uint16_t *data, size_t count, bool is_signed);
+
+    /// @brief Линейный перевод в 8 бит: dst = clamp(round(value * scale + offset), 0, 255)
+    /// @param src Значения (int16 или uint16 в зависимости от is_signed)
+    /// @param dst Результат, count байт
+    /// @param count Количество значений
+    /// @param is_signed Значения знаковые
+    void rescale(const uint16_t *src, uint8_t *dst, size_t count,
+                 bool is_signed, float scale, float offset);
+}
+
+
+#endif //INTENSITY_HPP
@@ -0,0 +1,82 @@
+#include "iso_surface.hpp"
+#include "trace.hpp"
+#include <cmath>
+#include <vtkNew.h>
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkFlyingEdges3D.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkReverseSense.h>
+#include <vtkMatrix4x4.h>
+
+
+namespace {
+    float length(const std::array<float, 3> &v) {
+        return std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+}
+
+vtkSmartPointer<vtkPolyData> ISO_SURFACE::extract(SEGMENTATION::Mask mask,
+                                                  const VOXEL_TRANSFORM::Affine &affine,
+                                                  double sigma) {
+    if(mask.empty())
+        return vtkSmartPointer<vtkPolyData>::New();
+
+    if(sigma > 0.0) {
+        // Сигма вдоль нормали - в срезах, по отношению шага пикселя к шагу среза
+        float slice_length = length(affine.slice_step);
+        double ratio = slice_length > 0.0f ? length(affine.col_step) / slice_length : 1.0;
+        int kernel = 2 * static_cast<int>(std::ceil(3.0 * sigma)) + 1;
+        SEGMENTATION::gaussian(mask, kernel, sigma, sigma * ratio);
+    }
+
+    // Маска передается в vtk без копирования, она живет до конца функции
+    vtkNew<vtkUnsignedCharArray> scalars;
+    scalars->SetArray(mask.voxels.data(), static_cast<vtkIdType>(mask.voxels.size()), 1);
+    vtkNew<vtkImageData> image;
+    image->SetDimensions(mask.cols, mask.rows, mask.slices);
+    image->SetSpacing(1.0, 1.0, 1.0);
+    image->SetOrigin(0.0, 0.0, 0.0);
+    image->GetPointData()->SetScalars(scalars);
+
+    vtkNew<vtkFlyingEdges3D> surface;
+    surface->SetInputData(image);
+    surface->SetValue(0, ISO_VALUE);
+    surface->ComputeNormalsOff();
+    surface->ComputeGradientsOff();
+    surface->ComputeScalarsOff();
+    {
+        TRACE_SCOPE("flying edges");
+        surface->Update();
+    }
+
+    // Индексы вокселов -> координаты пациента
+    vtkNew<vtkTransform> transform;
+    const double matrix[16] = {
+        affine.col_step[0], affine.row_step[0], affine.slice_step[0], affine.origin[0],
+        affine.col_step[1], affine.row_step[1], affine.slice_step[1], affine.origin[1],
+        affine.col_step[2], affine.row_step[2], affine.slice_step[2], affine.origin[2],
+        0.0,                0.0,                0.0,                  1.0
+    };
+    transform->SetMatrix(matrix);
+    vtkNew<vtkTransformPolyDataFilter> to_patient;
+    to_patient->SetInputConnection(surface->GetOutputPort());
+    to_patient->SetTransform(transform);
+    to_patient->Update();
+
+    vtkSmartPointer<vtkPolyData> result = vtkSmartPointer<vtkPolyData>::New();
+    // Отражение меняет обход треугольников, нормали должны смотреть наружу
+    if(transform->GetMatrix()->Determinant() < 0.0) {
+        vtkNew<vtkReverseSense> reverse;
+        reverse->SetInputConnection(to_patient->GetOutputPort());
+        reverse->ReverseCellsOn();
+        reverse->ReverseNormalsOff();
+        reverse->Update();
+        result->ShallowCopy(reverse->GetOutput());
+    } else {
+        result->ShallowCopy(to_patient->GetOutput());
+    }
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef ISO_SURFACE_HPP
+#define ISO_SURFACE_HPP
+
+#include "segmentation.hpp"
+#include "voxel_transform.hpp"
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+
+/// Построение поверхности головы изоповерхностью бинарной маски.
+/// Маска слегка сглаживается, чтобы убрать ступени вокселов, затем поверхность
+/// на половине яркости извлекается vtkFlyingEdges3D (многопоточный через vtkSMPTools)
+/// и переводится в систему координат пациента. Это быстрая альтернатива
+/// реконструкции CGAL по облаку точек
+namespace ISO_SURFACE {
+    /// Значение изоповерхности (между 0 и 255 бинарной маски)
+    constexpr double ISO_VALUE = 127.5;
+    /// Сигма сглаживания маски в пикселях (вдоль нормали пересчитывается по расстояниям)
+    constexpr double SMOOTH_SIGMA = 1.0;
+
+    /// @brief Извлекает поверхность маски
+    /// @param mask Маска головы (копия: сглаживается на месте)
+    /// @param affine Перевод индексов вокселов (столбец, строка, срез) в координаты пациента
+    /// @param sigma Сигма сглаживания маски, 0 - без сглаживания
+    /// @return Треугольная сетка в координатах пациента
+    vtkSmartPointer<vtkPolyData> extract(SEGMENTATION::Mask mask,
+                                         const VOXEL_TRANSFORM::Affine &affine,
+                                         double sigma = SMOOTH_SIGMA);
+}
+
+
+#endif //ISO_SURFACE_HPP
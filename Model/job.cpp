@@ -0,0 +1,35 @@
+#include "job.hpp"
+
+
+namespace {
+    thread_local std::shared_ptr<JOB::Token> current_token;
+}
+
+JOB::Token::Token(ProgressCallback callback): callback(std::move(callback)) {}
+
+void JOB::Token::report(double value, const std::string &stage) const {
+    if(callback)
+        callback(value, stage);
+}
+
+JOB::Scope::Scope(std::shared_ptr<Token> token): previous(std::move(current_token)) {
+    current_token = std::move(token);
+}
+
+JOB::Scope::~Scope() {
+    current_token = std::move(previous);
+}
+
+std::shared_ptr<JOB::Token> JOB::current() {
+    return current_token;
+}
+
+void JOB::checkpoint() {
+    if(current_token && current_token->cancelled())
+        throw Cancelled();
+}
+
+void JOB::progress(double value, const std::string &stage) {
+    if(current_token)
+        current_token->report(value, stage);
+}
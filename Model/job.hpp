@@ -0,0 +1,63 @@
+#ifndef JOB_HPP
+#define JOB_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <functional>
+
+
+/// Отмена и прогресс фоновых задач.
+/// Задача (например, загрузка исследования) создает Token и делает его текущим
+/// для своего потока через Scope. Этапы конвейера вызывают checkpoint() и progress()
+/// без явной передачи токена, PARALLEL::parallel_for переносит токен в рабочие потоки.
+/// Вне задачи обе функции ничего не делают
+namespace JOB {
+    /// Исключение, которым прерывается отмененная задача
+    class Cancelled: public std::runtime_error {
+    public:
+        Cancelled(): std::runtime_error("job cancelled") {}
+    };
+
+    /// Состояние фоновой задачи
+    class Token {
+    public:
+        /// Получает долю выполнения этапа [0, 1] и название этапа.
+        /// Может вызываться из любого потока задачи
+        using ProgressCallback = std::function<void(double, const std::string&)>;
+
+        explicit Token(ProgressCallback callback = nullptr);
+
+        void cancel()           { m_cancelled = true; }
+        bool cancelled() const  { return m_cancelled; }
+        void report(double value, const std::string &stage) const;
+
+    private:
+        std::atomic<bool> m_cancelled{false};
+        ProgressCallback callback;
+    };
+
+    /// Делает токен текущим для потока на время своей жизни
+    class Scope {
+    public:
+        explicit Scope(std::shared_ptr<Token> token);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        std::shared_ptr<Token> previous;
+    };
+
+    /// @brief Токен задачи, выполняемой в текущем потоке (или nullptr)
+    std::shared_ptr<Token> current();
+
+    /// @brief Выбрасывает Cancelled, если текущая задача отменена
+    void checkpoint();
+
+    /// @brief Сообщает о прогрессе этапа текущей задачи
+    void progress(double value, const std::string &stage);
+}
+
+
+#endif //JOB_HPP
@@ -0,0 +1,325 @@
+#include "mesh_export.hpp"
+#include "file_io.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+
+namespace {
+    /// Наибольшая длина строки вершины или треугольника DAE
+    constexpr size_t MAX_LINE = 64;
+    /// Наибольшая длина одного числа
+    constexpr size_t MAX_NUMBER = 32;
+    /// Строк DAE в блоке, который форматирует один поток
+    constexpr size_t LINES_PER_BLOCK = 16384;
+    /// Значащих цифр в координатах DAE (как у std::ostream по умолчанию)
+    constexpr int DAE_PRECISION = 6;
+
+    /// @brief Целое без учета локали
+    char *print_number(char *out, int64_t value) {
+        return std::to_chars(out, out + MAX_NUMBER, value).ptr;
+    }
+    char *print_number(char *out, size_t value) {
+        return std::to_chars(out, out + MAX_NUMBER, value).ptr;
+    }
+    /// @brief Число с плавающей точкой, как std::ostream по умолчанию (%g, 6 значащих цифр)
+    char *print_number(char *out, float value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        return std::to_chars(out, out + MAX_NUMBER, value, std::chars_format::general, DAE_PRECISION).ptr;
+#else
+        // std::to_chars для float есть только с libstdc++ 11 (GCC 11). Тот же текст дает
+        // snprintf("%g"), пока LC_NUMERIC - "C" (приложение задает ее при открытии исследования)
+        int length = std::snprintf(out, MAX_NUMBER, "%.*g", DAE_PRECISION, static_cast<double>(value));
+        return out + std::max(0, std::min(length, static_cast<int>(MAX_NUMBER) - 1));
+#endif
+    }
+
+    template<typename T>
+    void append_number(FILE_IO::Output &output, T value) {
+        output.commit(print_number(output.reserve(), value));
+    }
+
+    /// Фоновые задачи сохранения
+    std::mutex exports_mutex;
+    std::vector<std::future<void>> exports;
+
+    /// @brief Форматирует count строк параллельно блоками и дописывает их в файл по порядку.
+    /// Блоки обрабатываются окнами, поэтому в памяти одновременно лежит лишь часть текста
+    /// @param format format(i, out) пишет строку i (не длиннее MAX_LINE) и возвращает ее конец
+    template<typename Format>
+    void append_lines(FILE_IO::Output &output, size_t count, Format format) {
+        const size_t blocks = (count + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK;
+        const size_t window = 2 * static_cast<size_t>(PARALLEL::threads());
+        std::vector<std::vector<char>> texts(std::min(blocks, window));
+        for(size_t first = 0; first < blocks; first += window) {
+            const size_t last = std::min(blocks, first + window);
+            PARALLEL::parallel_for(last - first, [&](size_t b) {
+                const size_t begin = (first + b) * LINES_PER_BLOCK;
+                const size_t end = std::min(count, begin + LINES_PER_BLOCK);
+                std::vector<char> &text = texts[b];
+                text.resize((end - begin) * MAX_LINE);
+                char *out = text.data();
+                for(size_t i = begin; i != end; ++i)
+                    out = format(i, out);
+                text.resize(static_cast<size_t>(out - text.data()));
+            });
+            for(size_t b = 0; b != last - first; ++b)
+                output.append(texts[b].data(), texts[b].size());
+        }
+    }
+
+    /// @brief Путь к файлу модели с заданным расширением
+    std::string model_path(const std::string &directory, const std::string &filename, const char *extension) {
+        return directory + "/" + filename + extension;
+    }
+
+    /// @brief Количество треугольников после разбиения полигонов веером
+    uint32_t count_triangles(const PLY_IO::Mesh &mesh) {
+        uint32_t triangles = 0;
+        for(size_t pos = 0, face = 0; face != mesh.faces && pos < mesh.polygons.size(); ++face) {
+            const int32_t n = mesh.polygons[pos];
+            if(n >= 3)
+                triangles += static_cast<uint32_t>(n - 2);
+            pos += 1 + std::max<int32_t>(n, 0);
+        }
+        return triangles;
+    }
+}
+
+bool MESH_EXPORT::writeDAE(const std::string &path, const PLY_IO::Mesh &mesh) {
+    FILE_IO::Output output(path);
+    if(!output.good()) {
+        std::cerr << "Error: cannot open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    output.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n"
+                  "  <asset>\n"
+                  "    <contributor>\n"
+                  "      <author>MRobot</author>\n"
+                  "    </contributor>\n"
+                  "    <up_axis>Z_UP</up_axis>\n"
+                  "  </asset>\n"
+                  "\n"
+                  "  <library_geometries>\n"
+                  "    <geometry id=\"head_mesh\" name=\"head\">\n"
+                  "      <mesh>\n"
+                  "        <source id=\"mesh_points\">\n"
+                  "          <float_array name=\"values\" count=\"");
+    append_number(output, mesh.numberOfPoints() * 3);
+    output.append("\">\n            ");
+
+    // Числа форматируются std::to_chars (без локали и потоков ввода-вывода)
+    static const char VERTEX_END[] = "\n            ";
+    const float *points = mesh.points.data();
+    append_lines(output, mesh.numberOfPoints(), [points](size_t i, char *out) {
+        const float *xyz = points + 3 * i;
+        out = print_number(out, xyz[0]);
+        *out++ = ' ';
+        out = print_number(out, xyz[1]);
+        *out++ = ' ';
+        out = print_number(out, xyz[2]);
+        std::memcpy(out, VERTEX_END, sizeof(VERTEX_END) - 1);
+        return out + sizeof(VERTEX_END) - 1;
+    });
+
+    output.append("          </float_array>\n"
+                  "          <technique_common>\n"
+                  "            <accessor source=\"#values\" count=\"");
+    append_number(output, mesh.numberOfPoints());
+    output.append("\" stride=\"3\">\n"
+                  "              <param name=\"X\" type=\"float\"/>\n"
+                  "              <param name=\"Y\" type=\"float\"/>\n"
+                  "              <param name=\"Z\" type=\"float\"/>\n"
+                  "            </accessor>\n"
+                  "          </technique_common>\n"
+                  "        </source>\n"
+                  "\n"
+                  "        <triangles count=\"");
+    append_number(output, mesh.faces);
+    output.append("\">\n"
+                  "          <input semantic=\"POSITION\" source=\"#mesh_points\" offset=\"0\"/>\n"
+                  "          <p>\n");
+
+    // Начала полигонов находятся заранее, чтобы строки можно было форматировать независимо
+    std::vector<size_t> starts;
+    starts.reserve(mesh.faces);
+    for(size_t pos = 0; starts.size() != mesh.faces && pos < mesh.polygons.size();
+        pos += 1 + std::max<int32_t>(mesh.polygons[pos], 0))
+        starts.push_back(pos + 1);
+
+    static const char INDENT[] = "            ";
+    const int32_t *polygons = mesh.polygons.data();
+    append_lines(output, starts.size(), [polygons, &starts](size_t i, char *out) {
+        const int32_t *ids = polygons + starts[i];
+        std::memcpy(out, INDENT, sizeof(INDENT) - 1);
+        out += sizeof(INDENT) - 1;
+        out = print_number(out, static_cast<int64_t>(ids[0]));
+        *out++ = ' ';
+        out = print_number(out, static_cast<int64_t>(ids[1]));
+        *out++ = ' ';
+        out = print_number(out, static_cast<int64_t>(ids[2]));
+        *out++ = '\n';
+        return out;
+    });
+
+    output.append("        </p>\n"
+                  "        </triangles>\n"
+                  "      </mesh>\n"
+                  "    </geometry>\n"
+                  "  </library_geometries>\n"
+                  "\n"
+                  "  <library_visual_scenes>\n"
+                  "    <visual_scene id=\"Scene\" name=\"Scene\">\n"
+                  "      <node id=\"head_model\" name=\"Head_model\" type=\"NODE\">\n"
+                  "        <instance_geometry url=\"#head_mesh\" name=\"head_geometry\"/>\n"
+                  "      </node>\n"
+                  "    </visual_scene>\n"
+                  "  </library_visual_scenes>\n"
+                  "  \n"
+                  "</COLLADA>");
+    if(!output.close()) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MESH_EXPORT::writeSTL(const std::string &path, const PLY_IO::Mesh &mesh) {
+    FILE_IO::Output output(path);
+    if(!output.good()) {
+        std::cerr << "Error: cannot open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    // Заголовок: 80 байт текста и количество треугольников.
+    // Числа пишутся в порядке байтов машины (little endian на поддерживаемых платформах)
+    char header[80] = {};
+    std::strncpy(header, "binary STL, vtk_viewer head model", sizeof(header) - 1);
+    const uint32_t triangles = count_triangles(mesh);
+    output.append(header, sizeof(header));
+    output.append(&triangles, sizeof(triangles));
+
+    auto vertex = [&](int32_t id) {
+        return mesh.points.data() + 3 * static_cast<size_t>(id);
+    };
+    for(size_t pos = 0, face = 0; face != mesh.faces && pos < mesh.polygons.size(); ++face) {
+        const int32_t n = mesh.polygons[pos];
+        const int32_t *ids = mesh.polygons.data() + pos + 1;
+        for(int32_t j = 1; j + 1 < n; ++j) {
+            const float *a = vertex(ids[0]);
+            const float *b = vertex(ids[j]);
+            const float *c = vertex(ids[j + 1]);
+            float record[12];
+            const float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            const float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            record[0] = u[1] * v[2] - u[2] * v[1];
+            record[1] = u[2] * v[0] - u[0] * v[2];
+            record[2] = u[0] * v[1] - u[1] * v[0];
+            const float length = std::sqrt(record[0] * record[0] + record[1] * record[1] + record[2] * record[2]);
+            for(int k = 0; k != 3; ++k)
+                record[k] = length > 0.0f ? record[k] / length : 0.0f;
+            std::memcpy(record + 3, a, 3 * sizeof(float));
+            std::memcpy(record + 6, b, 3 * sizeof(float));
+            std::memcpy(record + 9, c, 3 * sizeof(float));
+
+            char *out = output.reserve();
+            std::memcpy(out, record, sizeof(record));
+            out += sizeof(record);
+            *out++ = 0;     // Атрибут (uint16) не используется
+            *out++ = 0;
+            output.commit(out);
+        }
+        pos += 1 + std::max<int32_t>(n, 0);
+    }
+    if(!output.close()) {
+        std::cerr << "Error: cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MESH_EXPORT::write(const PLY_IO::Mesh &mesh,
+                        const std::string &directory,
+                        const std::string &filename,
+                        unsigned formats) {
+    TRACE_SCOPE("export");
+    std::filesystem::create_directories(directory);
+
+    // Форматы независимы и только читают модель: каждый пишется в своем потоке,
+    // последний - в вызывающем
+    std::vector<std::function<bool()>> writers;
+    if(formats & DAE)
+        writers.emplace_back([&]() {
+            TRACE_SCOPE("export dae");
+            return writeDAE(model_path(directory, filename, ".dae"), mesh);
+        });
+    if(formats & PLY)
+        writers.emplace_back([&]() {
+            TRACE_SCOPE("export ply");
+            return PLY_IO::writeMesh(model_path(directory, filename, ".ply"), mesh);
+        });
+    if(formats & STL)
+        writers.emplace_back([&]() {
+            TRACE_SCOPE("export stl");
+            return writeSTL(model_path(directory, filename, ".stl"), mesh);
+        });
+    if(writers.empty())
+        return true;
+
+    std::vector<std::future<bool>> tasks;
+    for(size_t i = 0; i + 1 < writers.size(); ++i)
+        tasks.emplace_back(std::async(std::launch::async, writers[i]));
+    bool ok = writers.back()();
+    for(auto &task: tasks)
+        ok = task.get() && ok;
+    return ok;
+}
+
+void MESH_EXPORT::enqueue(vtkPolyData *model,
+                          const std::string &directory,
+                          const std::string &filename,
+                          unsigned formats,
+                          Done done) {
+    // Своя копия снимается в потоке вызывающего: после возврата он может отдать
+    // модель другим потокам. Копирование массивов дешевле перевода в плоский вид,
+    // он выполняется уже в фоне
+    auto copy = vtkSmartPointer<vtkPolyData>::New();
+    copy->DeepCopy(model);
+    std::lock_guard<std::mutex> lock(exports_mutex);
+    // Завершенные задачи больше не нужны
+    exports.erase(std::remove_if(exports.begin(), exports.end(), [](std::future<void> &task) {
+        return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), exports.end());
+    exports.emplace_back(std::async(std::launch::async, [copy, directory, filename, formats, done]() {
+        bool ok = false;
+        try {
+            ok = write(PLY_IO::fromPolyData(copy), directory, filename, formats);
+        } catch(const std::exception &e) {
+            std::cerr << "Error: model export failed: " << e.what() << std::endl;
+        }
+        if(done)
+            done(ok);
+    }));
+}
+
+void MESH_EXPORT::wait() {
+    std::vector<std::future<void>> pending;
+    {
+        std::lock_guard<std::mutex> lock(exports_mutex);
+        pending.swap(exports);
+    }
+    for(auto &task: pending)
+        task.wait();
+}
@@ -0,0 +1,60 @@
+#ifndef MESH_EXPORT_HPP
+#define MESH_EXPORT_HPP
+
+#include "ply_io.hpp"
+#include <functional>
+#include <string>
+#include <vtkPolyData.h>
+
+
+/// Сохранение готовой модели в файлы (DAE, двоичные PLY и STL).
+/// Модель один раз переводится в плоские массивы, после чего форматы
+/// пишутся одновременно, каждый в своем потоке. enqueue() выполняет
+/// все это в фоне: вызывающий сразу получает управление обратно
+namespace MESH_EXPORT {
+    /// Форматы файлов (битовая маска)
+    enum Format: unsigned {
+        DAE = 1u << 0,      /// COLLADA
+        PLY = 1u << 1,      /// PLY (формат по PLY_IO::defaultFormat(), по умолчанию двоичный)
+        STL = 1u << 2,      /// Двоичный STL
+        ALL = DAE | PLY | STL
+    };
+
+    /// Сигнал завершения фонового сохранения (вызывается в фоновом потоке).
+    /// ok == false, если хотя бы один файл не записан
+    using Done = std::function<void(bool ok)>;
+
+    /// @brief Записывает COLLADA (треугольники - первые три вершины каждого полигона)
+    /// Числа форматируются std::to_chars (%g, 6 значащих цифр - как std::ostream) параллельно
+    /// блоками строк и пишутся крупными порциями
+    bool writeDAE(const std::string &path, const PLY_IO::Mesh &mesh);
+
+    /// @brief Записывает двоичный STL (полигоны разбиваются на треугольники веером)
+    bool writeSTL(const std::string &path, const PLY_IO::Mesh &mesh);
+
+    /// @brief Записывает модель в <directory>/<filename>.<формат>, форматы - параллельно.
+    /// Возвращает управление после записи всех файлов
+    /// @param formats Маска Format
+    /// @return false, если хотя бы один файл не записан
+    bool write(const PLY_IO::Mesh &mesh,
+               const std::string &directory,
+               const std::string &filename,
+               unsigned formats = ALL);
+
+    /// @brief Ставит сохранение модели в очередь и сразу возвращает управление.
+    /// Модель копируется до возврата, поэтому на время вызова ее не должны
+    /// менять или читать другие потоки; после возврата вызывающий может
+    /// свободно пользоваться своей моделью
+    /// @param done Вызывается после записи всех файлов (может быть пустым)
+    void enqueue(vtkPolyData *model,
+                 const std::string &directory,
+                 const std::string &filename,
+                 unsigned formats = ALL,
+                 Done done = nullptr);
+
+    /// @brief Дожидается окончания всех поставленных в очередь сохранений
+    void wait();
+}
+
+
+#endif //MESH_EXPORT_HPP
@@ -1,184 +1,291 @@
 #include "model_builder.hpp"
 #include "head_cloud.hpp"
+#include "iso_surface.hpp"
+#include "mesh_export.hpp"
 #include "post_processing.hpp"
-#include <fstream>
-#include <filesystem>
+#include "study_cache.hpp"
+#include "surface_mesh.hpp"
+#include "trace.hpp"
+#include "job.hpp"
+#include "parallel.hpp"
+#include <iostream>
+#include <locale>
+#include <map>
+#include <sstream>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Scale_space_surface_reconstruction_3.h>
 #include <CGAL/Scale_space_reconstruction_3/Advancing_front_mesher.h>
+#include <CGAL/Scale_space_reconstruction_3/Weighted_PCA_smoother.h>
+#include <CGAL/Default_diagonalize_traits.h>
+#ifdef CGAL_LINKED_WITH_TBB
+#include <tbb/global_control.h>
+#endif
 
 
+/// Сглаживание (поиск соседей и PCA по точкам) распараллеливается средствами CGAL,
+/// если он собран с TBB; иначе выполняется последовательно
+#ifdef CGAL_LINKED_WITH_TBB
+typedef CGAL::Parallel_tag   Concurrency_tag;
+#else
+typedef CGAL::Sequential_tag Concurrency_tag;
+#endif
+
 typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
 typedef CGAL::Scale_space_surface_reconstruction_3<Kernel>                 Reconstruction;
-typedef CGAL::Scale_space_reconstruction_3::Weighted_PCA_smoother<Kernel>  Smoother;
+typedef CGAL::Scale_space_reconstruction_3::Weighted_PCA_smoother<
+            Kernel, CGAL::Default_diagonalize_traits<Kernel::FT, 3>, Concurrency_tag> Smoother;
 typedef CGAL::Scale_space_reconstruction_3::Advancing_front_mesher<Kernel> Mesher;
 typedef Reconstruction::Facet_const_iterator Facet_iterator;
-typedef Reconstruction::Point                Point_ss;
 
 
 namespace {
+    using Meta = std::map<std::string, std::string>;
+
+    /// Шагов сглаживания scale space (increase_scale)
+    constexpr unsigned SCALE_ITERATIONS = 4;
+    /// Наибольшая длина ребра треугольника Advancing_front_mesher, мм
+    constexpr double MESHER_MAX_FACET_LENGTH = 20.0;
+
+    /// @brief Число для строки параметров без учета локали (как std::ostream по умолчанию)
+    std::string parameter(double value);
+
+    /// @brief Строит поверхность выбранным способом (в памяти, без записи на диск)
+    /// @param volume Объем исследования
+    /// @param backend Способ построения
+    /// @param cache_key Ключ кэша облака точек (пустой - без кэша)
+    /// @param meta Сведения о построении для записи в кэш
+    /// @return Поверхность до постобработки
+    vtkSmartPointer<vtkPolyData> build_surface(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                               MODEL_BUILDER::Backend backend,
+                                               const std::string &cache_key,
+                                               Meta &meta);
+
+    /// @brief Изоповерхность объемной маски головы
+    /// @param volume Объем исследования
+    /// @return Поверхность в координатах пациента
+    vtkSmartPointer<vtkPolyData> iso_surface(std::shared_ptr<const STUDY_VOLUME::Volume> volume);
+
     /// @brief Выполняет построение полигональной модели по облаку точек
     /// @param cloud Заданное облако точек
-    /// @param model_directory Путь, куда сохраняется модель
-    /// @param filename Имя сохраняемой модели (без формата)
-    /// @param format Формат сохранения модели
-    void build_model(std::vector<cv::Point3f> &cloud,
-                     const std::string &model_directory,
-                     const std::string &model_path);
+    /// @return Полигональная модель
+    vtkSmartPointer<vtkPolyData> build_model(const std::vector<cv::Point3f> &cloud);
     
     /// @brief Перевод типа данных облака точек openCV в CGAL
     /// @param cv_cloud Облако точек openCV
     /// @return Облако точек CGAL
-    std::vector<Kernel::Point_3> cast_cloud_CV2CGAL(std::vector<cv::Point3f> &cv_cloud);
+    std::vector<Kernel::Point_3> cast_cloud_CV2CGAL(const std::vector<cv::Point3f> &cv_cloud);
 
-    /// @brief Построение модели полигональной модели по облаку точек методом space scale
-    /// @param cloud - Исходное облако точек
-    /// @return Полигональная модель в представлении CGAL
-    Reconstruction space_scale(std::vector<Kernel::Point_3> &cloud);
+    /// @brief Построение модели полигональной модели по облаку точек методом space scale.
+    /// Состояние CGAL живет только внутри функции, наружу выходят плоские массивы
+    /// @param cloud - Исходное облако точек (освобождается после передачи в CGAL)
+    /// @return Полигональная модель
+    SURFACE_MESH::Mesh space_scale(std::vector<Kernel::Point_3> &&cloud);
 
-    /// @brief Сохранение полученной полигональной модели в формате PLY
+    /// @brief Перенос точек и треугольников реконструкции CGAL в плоские массивы
     /// @param reconstruct Полигональная модель в представлении CGAL
-    /// @param model_directory Директория, куда сохраняется модель
-    /// @param fileName Имя сохраняемой модели
-    void save_to_ply(Reconstruction reconstruct,
-                     const std::string &model_directory,
-                     const std::string &fileName);
+    SURFACE_MESH::Mesh to_mesh(const Reconstruction &reconstruct);
 
-    /// @brief Сохранение полученной полигональной модели в формате DAE
-    /// @param reconstruct Полигональная модель в представлении CGAL
-    /// @param model_directory Директория, куда сохраняется модель
-    /// @param fileName Имя сохраняемой модели
-    void save_to_dae(Reconstruction reconstruct,
-                     const std::string &model_directory,
-                     const std::string &fileName);
+}
+
+std::string MODEL_BUILDER::backendName(Backend backend) {
+    switch(backend) {
+        case Backend::IsoSurface: return "iso_surface";
+        default:                  return "scale_space";
+    }
+}
+
+bool MODEL_BUILDER::parseBackend(const std::string &name, Backend &backend) {
+    if(name == "scale_space")
+        backend = Backend::ScaleSpace;
+    else if(name == "iso_surface")
+        backend = Backend::IsoSurface;
+    else
+        return false;
+    return true;
 }
 
 void MODEL_BUILDER::build(const std::string &dcm_path,
                           const std::string &model_directory,
                           const std::string &filename,
-                          bool visualise) {
-    std::vector<cv::Point3f> cloud = HEAD_POINT_CLOUD::head_cloud(dcm_path);
-    build_model(cloud, model_directory, filename);
-    VTK_POSTPROCESSING::postprocess(model_directory, filename, visualise);
+                          bool visualise,
+                          Backend backend) {
+    Meta meta;
+    vtkSmartPointer<vtkPolyData> surface = build_surface(STUDY_VOLUME::read(dcm_path), backend, std::string(), meta);
+    vtkSmartPointer<vtkPolyData> model = VTK_POSTPROCESSING::postprocess(surface);
+    VTK_POSTPROCESSING::exportModel(model, model_directory, filename);
+    if(visualise)
+        VTK_POSTPROCESSING::visualise(model);
 }
 
 vtkSmartPointer<vtkPolyData> MODEL_BUILDER::build(const std::string &dcm_path,
                                                   const std::string &model_directory,
-                                                  const std::string &filename) {
-    std::vector<cv::Point3f> cloud = HEAD_POINT_CLOUD::head_cloud(dcm_path);
-    build_model(cloud, model_directory, filename);
-    return VTK_POSTPROCESSING::postprocess(model_directory, filename, false);
+                                                  const std::string &filename,
+                                                  Backend backend) {
+    Meta meta;
+    vtkSmartPointer<vtkPolyData> surface = build_surface(STUDY_VOLUME::read(dcm_path), backend, std::string(), meta);
+    vtkSmartPointer<vtkPolyData> model = VTK_POSTPROCESSING::postprocess(surface);
+    VTK_POSTPROCESSING::exportModel(model, model_directory, filename);
+    return model;
+}
+
+vtkSmartPointer<vtkPolyData> MODEL_BUILDER::build(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                                  const std::string &model_directory,
+                                                  const std::string &filename,
+                                                  const std::string &cache_key,
+                                                  Backend backend,
+                                                  bool export_files) {
+    TRACE_SCOPE("model build");
+    if(!cache_key.empty()) {
+        if(vtkSmartPointer<vtkPolyData> cached = STUDY_CACHE::loadMesh(cache_key)) {
+            std::cout << "Model loaded from cache" << std::endl;
+            return cached;
+        }
+    }
+
+    Meta meta = {{"parameters", parameters(backend)}};
+    vtkSmartPointer<vtkPolyData> surface = build_surface(std::move(volume), backend, cache_key, meta);
+    JOB::checkpoint();
+    JOB::progress(0.0, "postprocessing");
+    // Модель передается в постобработку в памяти, без промежуточного файла
+    vtkSmartPointer<vtkPolyData> model = VTK_POSTPROCESSING::postprocess(surface);
+    JOB::checkpoint();
+
+    if(!cache_key.empty()) {
+        meta["mesh_points"] = std::to_string(model->GetNumberOfPoints());
+        meta["mesh_cells"] = std::to_string(model->GetNumberOfCells());
+        STUDY_CACHE::saveMesh(cache_key, model);
+        STUDY_CACHE::saveMeta(cache_key, meta);
+    }
+    if(export_files)
+        MESH_EXPORT::enqueue(model, model_directory, filename);
+    return model;
+}
+
+vtkSmartPointer<vtkPolyData> MODEL_BUILDER::reconstruct(const std::vector<cv::Point3f> &cloud) {
+    return build_model(cloud);
+}
+
+std::string MODEL_BUILDER::concurrency() {
+#ifdef CGAL_LINKED_WITH_TBB
+    return "tbb";
+#else
+    return "sequential";
+#endif
+}
+
+void MODEL_BUILDER::waitForExports() {
+    MESH_EXPORT::wait();
+}
+
+std::string MODEL_BUILDER::parameters(Backend backend) {
+    const std::string postprocess = "postprocess:" + VTK_POSTPROCESSING::describe(VTK_POSTPROCESSING::pipeline());
+    if(backend == Backend::IsoSurface)
+        return "segmentation:volume3d;iso_surface:flying_edges,sigma=" + parameter(ISO_SURFACE::SMOOTH_SIGMA) +
+               ",value=" + parameter(ISO_SURFACE::ISO_VALUE) + ";" + postprocess;
+    return "head_cloud:volume3d,voxel_grid=" + std::to_string(DECIMATION::DEFAULT_SPACING) +
+           ";space_scale:smoother=" + std::to_string(SCALE_ITERATIONS) +
+           ",mesher=" + parameter(MESHER_MAX_FACET_LENGTH) + ";" + postprocess;
 }
 
 namespace {
-    void build_model(std::vector<cv::Point3f> &cv_cloud,
-                     const std::string &model_directory,
-                     const std::string &filename) {
+    vtkSmartPointer<vtkPolyData> build_surface(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                               MODEL_BUILDER::Backend backend,
+                                               const std::string &cache_key,
+                                               Meta &meta) {
+        if(backend == MODEL_BUILDER::Backend::IsoSurface) {
+            JOB::progress(0.0, "segmentation");
+            vtkSmartPointer<vtkPolyData> surface = iso_surface(std::move(volume));
+            meta["surface_points"] = std::to_string(surface->GetNumberOfPoints());
+            return surface;
+        }
+
+        std::vector<cv::Point3f> cloud;
+        if(cache_key.empty() || !STUDY_CACHE::loadCloud(cache_key, cloud)) {
+            JOB::progress(0.0, "cloud");
+            cloud = HEAD_POINT_CLOUD::head_cloud(std::move(volume));
+            if(!cache_key.empty())
+                STUDY_CACHE::saveCloud(cache_key, cloud);
+        }
+        meta["cloud_points"] = std::to_string(cloud.size());
+
+        JOB::checkpoint();
+        JOB::progress(0.0, "reconstruction");
+        return build_model(cloud);
+    }
+
+    vtkSmartPointer<vtkPolyData> iso_surface(std::shared_ptr<const STUDY_VOLUME::Volume> volume) {
+        std::cout << "Segmenting head volume" << std::endl;
+        HEAD_POINT_CLOUD::HeadCloud data(std::move(volume));
+        data.sort();
+        JOB::checkpoint();
+        data.equalizeImages();
+        JOB::checkpoint();
+        SEGMENTATION::Mask mask = data.headMask();
+        JOB::checkpoint();
+        std::cout << "Extracting iso-surface" << std::endl;
+        return ISO_SURFACE::extract(std::move(mask), data.maskAffine());
+    }
+
+    vtkSmartPointer<vtkPolyData> build_model(const std::vector<cv::Point3f> &cv_cloud) {
+        TRACE_SCOPE("reconstruction");
         std::cout << "Calculating Cloud" << std::endl;
         std::vector<Kernel::Point_3> cloud = cast_cloud_CV2CGAL(cv_cloud);
         std::cout << "Building Model" << std::endl;
-        Reconstruction reconstruct = space_scale(cloud);
-        std::cout << "Saving" << std::endl;
-        std::filesystem::create_directories(model_directory);
-        save_to_ply(reconstruct, model_directory, filename);
+        SURFACE_MESH::Mesh mesh = space_scale(std::move(cloud));
+        return SURFACE_MESH::toPolyData(std::move(mesh));
     }
 
-    std::vector<Kernel::Point_3> cast_cloud_CV2CGAL(std::vector<cv::Point3f> &cv_cloud) {
+    std::vector<Kernel::Point_3> cast_cloud_CV2CGAL(const std::vector<cv::Point3f> &cv_cloud) {
         std::vector<Kernel::Point_3> cloud;
+        cloud.reserve(cv_cloud.size());
         for(auto &cv_point: cv_cloud)
             cloud.emplace_back(Kernel::Point_3(cv_point.x, cv_point.y, cv_point.z));
         return cloud;
     }
 
-    Reconstruction space_scale(std::vector<Kernel::Point_3> &cloud) {
+    SURFACE_MESH::Mesh space_scale(std::vector<Kernel::Point_3> &&cloud) {
+#ifdef CGAL_LINKED_WITH_TBB
+        // Количество потоков TBB ограничивается общей настройкой PARALLEL::setThreads
+        tbb::global_control threads(tbb::global_control::max_allowed_parallelism, PARALLEL::threads());
+#endif
         Reconstruction reconstruct(cloud.begin(), cloud.end());
-        reconstruct.increase_scale<Smoother>(4);
-        reconstruct.reconstruct_surface(Mesher(20));
-        return reconstruct;
+        // CGAL хранит свою копию точек
+        std::vector<Kernel::Point_3>().swap(cloud);
+        {
+            TRACE_SCOPE("cgal smooth");
+            reconstruct.increase_scale<Smoother>(SCALE_ITERATIONS);
+        }
+        {
+            TRACE_SCOPE("cgal mesh");
+            reconstruct.reconstruct_surface(Mesher(MESHER_MAX_FACET_LENGTH));
+        }
+        return to_mesh(reconstruct);
     }
 
-    void save_to_ply(Reconstruction reconstruct,
-                     const std::string &model_directory,
-                     const std::string &fileName) {
-        std::ofstream outputFile(model_directory + "/" + fileName + ".ply");
-
-        outputFile << "ply\n";
-        outputFile << "format ascii 1.0\n";
-        outputFile << "element vertex " << reconstruct.number_of_points() << "\n";
-        outputFile << "property float32 x\n";
-        outputFile << "property float32 y\n";
-        outputFile << "property float32 z\n";
-        outputFile << "element face " << reconstruct.number_of_facets() << "\n";
-        outputFile << "property list uint8 int32 vertex_indices\n";
-        outputFile << "end_header\n";
-
-        std::copy(reconstruct.points_begin(),
-                  reconstruct.points_end(), 
-                  std::ostream_iterator<Point_ss>(outputFile, "\n"));
-
-        for(Facet_iterator it  = reconstruct.facets_begin(); it != reconstruct.facets_end(); it++)
-            outputFile << "3 " << *it << "\n";
+    std::string parameter(double value) {
+        std::ostringstream stream;
+        stream.imbue(std::locale::classic());
+        stream << value;
+        return stream.str();
     }
 
-    void save_to_dae(Reconstruction reconstruct,
-                     const std::string &model_directory,
-                     const std::string &fileName) {
-        std::ofstream outputFile(model_directory + "/" + fileName + ".dae");
-
-        outputFile << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-                      "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n"
-                      "  <asset>\n"
-                      "    <contributor>\n"
-                      "      <author>MRobot</author>\n"
-                      "    </contributor>\n"
-                      "    <up_axis>Z_UP</up_axis>\n"
-                      "  </asset>\n"
-                      "\n"
-                      "  <library_geometries>\n"
-                      "    <geometry id=\"head_mesh\" name=\"head\">\n"
-                      "      <mesh>\n"
-                      "        <source id=\"mesh_points\">\n"
-                      "          <float_array name=\"values\" count=\"";
-
-        outputFile << reconstruct.number_of_points() * 3 << "\">\n            ";
-
-        std::copy(reconstruct.points_begin(),
-                  reconstruct.points_end(), 
-                  std::ostream_iterator<Point_ss>(outputFile, "\n            "));
-
-        outputFile << "          </float_array>\n"
-                      "          <technique_common>\n"
-                      "            <accessor source=\"#values\" count=\"";
-        outputFile << reconstruct.number_of_points() << "\" stride=\"3\">\n"
-                      "              <param name=\"X\" type=\"float\"/>\n"
-                      "              <param name=\"Y\" type=\"float\"/>\n"
-                      "              <param name=\"Z\" type=\"float\"/>\n"
-                      "            </accessor>\n"
-                      "          </technique_common>\n"
-                      "        </source>\n"
-                      "\n"
-                      "        <triangles count=\"";
-        outputFile << reconstruct.number_of_facets() << "\">\n";
-        outputFile << "          <input semantic=\"POSITION\" source=\"#mesh_points\" offset=\"0\"/>\n"
-                      "          <p>\n";
-
-        for(Facet_iterator it  = reconstruct.facets_begin(); it != reconstruct.facets_end(); it++)
-            outputFile << "            " << *it << "\n";
-
-        outputFile << "        </p>\n"
-                      "        </triangles>\n"
-                      "      </mesh>\n"
-                      "    </geometry>\n"
-                      "  </library_geometries>\n"
-                      "\n"
-                      "  <library_visual_scenes>\n"
-                      "    <visual_scene id=\"Scene\" name=\"Scene\">\n"
-                      "      <node id=\"head_model\" name=\"Head_model\" type=\"NODE\">\n"
-                      "        <instance_geometry url=\"#head_mesh\" name=\"head_geometry\"/>\n"
-                      "      </node>\n"
-                      "    </visual_scene>\n"
-                      "  </library_visual_scenes>\n"
-                      "  \n"
-                      "</COLLADA>";
+    SURFACE_MESH::Mesh to_mesh(const Reconstruction &reconstruct) {
+        SURFACE_MESH::Mesh mesh;
+        mesh.points = SURFACE_MESH::Buffer<float>(reconstruct.number_of_points() * 3);
+        float *xyz = mesh.points.data();
+        for(auto it = reconstruct.points_begin(); it != reconstruct.points_end(); ++it) {
+            *xyz++ = static_cast<float>(it->x());
+            *xyz++ = static_cast<float>(it->y());
+            *xyz++ = static_cast<float>(it->z());
+        }
+
+        mesh.triangles = SURFACE_MESH::Buffer<int32_t>(reconstruct.number_of_facets() * 3);
+        int32_t *ids = mesh.triangles.data();
+        for(Facet_iterator it = reconstruct.facets_begin(); it != reconstruct.facets_end(); ++it) {
+            *ids++ = static_cast<int32_t>((*it)[0]);
+            *ids++ = static_cast<int32_t>((*it)[1]);
+            *ids++ = static_cast<int32_t>((*it)[2]);
+        }
+        return mesh;
     }
 } //namespace
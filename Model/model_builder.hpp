@@ -2,27 +2,85 @@
 #define MODEL_BUILDER_HPP
 
 #include <string>
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
 #include <vtkPolyData.h>
 
 
+namespace STUDY_VOLUME {
+    struct Volume;
+}
+
+
 namespace MODEL_BUILDER {
+    /// Способ построения поверхности головы
+    enum class Backend {
+        ScaleSpace,     /// Реконструкция CGAL (scale space) по облаку точек контуров
+        IsoSurface      /// Изоповерхность объемной маски головы (flying edges)
+    };
+
+    /// @brief Название способа построения (scale_space, iso_surface)
+    std::string backendName(Backend backend);
+
+    /// @brief Разбирает название способа построения
+    /// @return false, если название неизвестно
+    bool parseBackend(const std::string &name, Backend &backend);
+
     /// @brief Построение полигональной модели по данным исследований в формате DICOM
     /// @param dcm_path Путь к репозиторию с исследованием
     /// @param model_directory Путь к репозиторию, в который будет сохранена модель
     /// @param filename Имя сохраняемой модели (без указания формата)
     /// @param visualise Визуализация построенной модели
+    /// @param backend Способ построения поверхности
     void build(const std::string &dcm_path,
                const std::string &model_directory,
                const std::string &filename,
-               bool visualise);
+               bool visualise,
+               Backend backend = Backend::ScaleSpace);
     
     /// @brief Построение полигональной модели по данным исследований в формате DICOM
     /// @param dcm_path Путь к репозиторию с исследованием
     /// @param model_directory Путь к репозиторию, в который будет сохранена модель
     /// @param filename Имя сохраняемой модели (без указания формата)
+    /// @param backend Способ построения поверхности
     vtkSmartPointer<vtkPolyData> build(const std::string &dcm_path,
                                        const std::string &model_directory,
-                                       const std::string &filename);
+                                       const std::string &filename,
+                                       Backend backend = Backend::ScaleSpace);
+
+    /// @brief Построение полигональной модели по уже прочитанному исследованию
+    /// @param volume Объем исследования (общий с просмотрщиками, не копируется)
+    /// @param model_directory Путь к репозиторию, в который будет сохранена модель
+    /// @param filename Имя сохраняемой модели (без указания формата)
+    /// @param cache_key Ключ записи STUDY_CACHE. Если задан, облако точек и модель
+    ///                  берутся из кэша при наличии и сохраняются в него после построения
+    ///                  (ключ должен строиться по parameters(backend))
+    /// @param backend Способ построения поверхности
+    /// @param export_files Сохранить модель (DAE, PLY, STL) в model_directory. Сохранение идет
+    ///                     в фоне и не задерживает возврат модели (MESH_EXPORT::enqueue,
+    ///                     см. waitForExports)
+    vtkSmartPointer<vtkPolyData> build(std::shared_ptr<const STUDY_VOLUME::Volume> volume,
+                                       const std::string &model_directory,
+                                       const std::string &filename,
+                                       const std::string &cache_key = std::string(),
+                                       Backend backend = Backend::ScaleSpace,
+                                       bool export_files = true);
+
+    /// @brief Реконструкция CGAL (scale space) по готовому облаку точек, без постобработки.
+    /// При сборке CGAL с TBB сглаживание выполняется в PARALLEL::threads() потоков
+    /// @param cloud Облако точек поверхности
+    vtkSmartPointer<vtkPolyData> reconstruct(const std::vector<cv::Point3f> &cloud);
+
+    /// @brief Режим реконструкции CGAL: tbb или sequential
+    std::string concurrency();
+
+    /// @brief Дожидается окончания фонового сохранения моделей
+    void waitForExports();
+
+    /// @brief Описание параметров построения модели, влияющих на результат.
+    /// Входит в ключ кэша, поэтому при изменении параметров старые записи не используются
+    std::string parameters(Backend backend = Backend::ScaleSpace);
 }
 
 
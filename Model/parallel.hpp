@@ -0,0 +1,105 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include "job.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace PARALLEL {
+    /// Ограничение числа потоков, заданное через setThreads (0 - по умолчанию)
+    inline std::atomic<unsigned> thread_limit{0};
+
+    /// @brief Задает количество рабочих потоков по умолчанию для всего процесса
+    /// (например, для сравнения скорости при разном числе потоков)
+    /// @param n Количество потоков, 0 - по умолчанию
+    inline void setThreads(unsigned n) {
+        thread_limit = n;
+    }
+
+    /// @brief Количество потоков по умолчанию: $VTK_VIEWER_THREADS, иначе число ядер.
+    /// Переменная окружения читается один раз
+    inline unsigned defaultThreads() {
+        static const unsigned value = []() -> unsigned {
+            if(const char *env = std::getenv("VTK_VIEWER_THREADS")) {
+                char *end = nullptr;
+                long n = std::strtol(env, &end, 10);
+                if(end != env && *end == '\0' && n > 0)
+                    return static_cast<unsigned>(n);
+                std::cerr << "Warning: cannot parse VTK_VIEWER_THREADS=" << env
+                          << ", all cores are used" << std::endl;
+            }
+            unsigned cores = std::thread::hardware_concurrency();
+            return cores ? cores : 1;
+        }();
+        return value;
+    }
+
+    /// @brief Количество рабочих потоков: заданное через setThreads, иначе defaultThreads()
+    inline unsigned threads() {
+        if(unsigned limit = thread_limit)
+            return limit;
+        return defaultThreads();
+    }
+
+    /// @brief Выполняет func(i) для всех i из [0, count) на пуле из num_threads потоков.
+    /// Индексы раздаются динамически через атомарный счетчик, поэтому неравномерная
+    /// нагрузка (разные размеры файлов, срезов) распределяется сама собой.
+    /// Первое выброшенное в потоке исключение пробрасывается вызывающему.
+    /// Токен текущей задачи (JOB) переносится в рабочие потоки, а перед каждой
+    /// задачей проверяется отмена
+    /// @param count Количество задач
+    /// @param func Обработчик задачи, принимает индекс
+    /// @param num_threads Количество потоков (вызывающий поток тоже работает)
+    template<typename Func>
+    void parallel_for(size_t count, Func &&func, unsigned num_threads = threads()) {
+        num_threads = static_cast<unsigned>(std::min<size_t>(num_threads, count));
+        if(num_threads <= 1) {
+            for(size_t i = 0; i != count; ++i) {
+                JOB::checkpoint();
+                func(i);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        std::shared_ptr<JOB::Token> token = JOB::current();
+        auto worker = [&]() {
+            JOB::Scope scope(token);
+            try {
+                for(size_t i = next++; i < count; i = next++) {
+                    JOB::checkpoint();
+                    func(i);
+                }
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error)
+                    error = std::current_exception();
+                // Останавливаем раздачу оставшихся задач
+                next = count;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(num_threads - 1);
+        for(unsigned t = 1; t < num_threads; ++t)
+            pool.emplace_back(worker);
+        worker();
+        for(auto &thread: pool)
+            thread.join();
+
+        if(error)
+            std::rethrow_exception(error);
+    }
+}
+
+
+#endif //PARALLEL_HPP
@@ -0,0 +1,551 @@
+#include "ply_io.hpp"
+#include "file_io.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkFloatArray.h>
+#include <vtkCellArray.h>
+#include <vtkVersionMacros.h>
+#if VTK_MAJOR_VERSION >= 9
+#include <vtkTypeInt32Array.h>
+#else
+#include <vtkIdTypeArray.h>
+#endif
+
+
+namespace {
+    static_assert(sizeof(cv::Point3f) == 3 * sizeof(float), "cv::Point3f must be three packed floats");
+
+    bool littleEndian() {
+        const uint16_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    template<typename T>
+    T swapBytes(T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for(size_t i = 0; i != sizeof(T) / 2; ++i)
+            std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    /// @brief Общая запись: points - count троек float, polygons - [n, ids...] для faces полигонов
+    bool writePly(const std::string &path, const float *points, size_t count,
+                  const int32_t *polygons, size_t polygon_ids, size_t faces,
+                  PLY_IO::Format format) {
+        FILE_IO::Output output(path);
+        if(!output.good()) {
+            std::cerr << "Error: cannot open " << path << " for writing" << std::endl;
+            return false;
+        }
+        const bool binary = format == PLY_IO::Format::Binary;
+        output.append(std::string("ply\nformat ") + (binary ? "binary_little_endian" : "ascii") + " 1.0\n"
+                      "element vertex " + std::to_string(count) + "\n"
+                      "property float32 x\n"
+                      "property float32 y\n"
+                      "property float32 z\n"
+                      "element face " + std::to_string(faces) + "\n"
+                      "property list uint8 int32 vertex_indices\n"
+                      "end_header\n");
+
+        const bool swap = !littleEndian();
+        if(binary && !swap) {
+            output.append(points, count * 3 * sizeof(float));
+        } else {
+            for(size_t i = 0; i != count * 3; i += 3) {
+                if(binary) {
+                    float xyz[3] = {swapBytes(points[i]), swapBytes(points[i + 1]), swapBytes(points[i + 2])};
+                    output.append(xyz, sizeof(xyz));
+                } else {
+                    // 9 значащих цифр - float восстанавливается без потерь
+                    output.print("%.9g %.9g %.9g\n", points[i], points[i + 1], points[i + 2]);
+                }
+            }
+        }
+
+        for(size_t pos = 0, face = 0; face != faces && pos < polygon_ids; ++face) {
+            const int32_t n = polygons[pos++];
+            if(n < 0 || n > 255 || pos + n > polygon_ids) {
+                std::cerr << "Error: invalid polygon in " << path << std::endl;
+                return false;
+            }
+            if(binary) {
+                uint8_t record[1 + 255 * sizeof(int32_t)];
+                record[0] = static_cast<uint8_t>(n);
+                for(int32_t j = 0; j != n; ++j) {
+                    int32_t id = swap ? swapBytes(polygons[pos + j]) : polygons[pos + j];
+                    std::memcpy(record + 1 + j * sizeof(int32_t), &id, sizeof(int32_t));
+                }
+                output.append(record, 1 + n * sizeof(int32_t));
+            } else {
+                output.print("%d", n);
+                for(int32_t j = 0; j != n; ++j)
+                    output.print(" %d", polygons[pos + j]);
+                output.append("\n", 1);
+            }
+            pos += n;
+        }
+
+        if(!output.close()) {
+            std::cerr << "Error: cannot write " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    enum class Type { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Unknown };
+
+    Type parseType(const std::string &name) {
+        if(name == "char" || name == "int8")     return Type::Int8;
+        if(name == "uchar" || name == "uint8")   return Type::UInt8;
+        if(name == "short" || name == "int16")   return Type::Int16;
+        if(name == "ushort" || name == "uint16") return Type::UInt16;
+        if(name == "int" || name == "int32")     return Type::Int32;
+        if(name == "uint" || name == "uint32")   return Type::UInt32;
+        if(name == "float" || name == "float32") return Type::Float32;
+        if(name == "double" || name == "float64") return Type::Float64;
+        return Type::Unknown;
+    }
+
+    size_t typeSize(Type type) {
+        switch(type) {
+            case Type::Int8: case Type::UInt8:                      return 1;
+            case Type::Int16: case Type::UInt16:                    return 2;
+            case Type::Int32: case Type::UInt32: case Type::Float32: return 4;
+            case Type::Float64:                                     return 8;
+            default:                                                return 0;
+        }
+    }
+
+    struct Property {
+        std::string name;
+        Type type = Type::Unknown;          /// Тип значения (элементов списка)
+        bool list = false;
+        Type count_type = Type::Unknown;    /// Тип длины списка
+    };
+
+    struct Element {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+    };
+
+    /// @brief Разбирает заголовок; body - смещение первого байта данных
+    bool parseHeader(const char *data, size_t size, bool &binary,
+                     std::vector<Element> &elements, size_t &body) {
+        const std::string end_marker = "end_header";
+        size_t pos = 0;
+        bool format_found = false;
+        auto next_line = [&](std::string &line) {
+            size_t end = pos;
+            while(end < size && data[end] != '\n')
+                ++end;
+            if(end >= size)
+                return false;
+            line.assign(data + pos, end - pos);
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+            pos = end + 1;
+            return true;
+        };
+
+        std::string line;
+        if(!next_line(line) || line != "ply")
+            return false;
+        while(next_line(line)) {
+            std::vector<std::string> words;
+            for(size_t i = 0; i < line.size();) {
+                size_t j = line.find(' ', i);
+                if(j == std::string::npos)
+                    j = line.size();
+                if(j > i)
+                    words.emplace_back(line, i, j - i);
+                i = j + 1;
+            }
+            if(words.empty() || words[0] == "comment" || words[0] == "obj_info")
+                continue;
+            if(words[0] == end_marker) {
+                body = pos;
+                return format_found;
+            }
+            if(words[0] == "format" && words.size() >= 2) {
+                if(words[1] == "binary_little_endian")
+                    binary = true;
+                else if(words[1] == "ascii")
+                    binary = false;
+                else
+                    return false;
+                format_found = true;
+            } else if(words[0] == "element" && words.size() >= 3) {
+                Element element;
+                element.name = words[1];
+                element.count = std::strtoull(words[2].c_str(), nullptr, 10);
+                elements.push_back(element);
+            } else if(words[0] == "property" && !elements.empty()) {
+                Property property;
+                if(words.size() >= 5 && words[1] == "list") {
+                    property.list = true;
+                    property.count_type = parseType(words[2]);
+                    property.type = parseType(words[3]);
+                    property.name = words[4];
+                } else if(words.size() >= 3) {
+                    property.type = parseType(words[1]);
+                    property.name = words[2];
+                }
+                if(property.type == Type::Unknown || (property.list && property.count_type == Type::Unknown))
+                    return false;
+                elements.back().properties.push_back(property);
+            }
+        }
+        return false;
+    }
+
+    /// Последовательное чтение значений из двоичных данных или текста
+    class Reader {
+    public:
+        Reader(const char *begin, const char *end, bool binary, bool swap):
+            pos(begin), end(end), binary(binary), swap(swap) {}
+
+        bool good() const { return ok; }
+
+        double value(Type type) {
+            if(binary)
+                return binaryValue(type);
+            // Текст: пропуск пробелов и разбор числа
+            while(pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t'))
+                ++pos;
+            char token[64];
+            size_t length = 0;
+            while(pos < end && length + 1 < sizeof(token) &&
+                  *pos != ' ' && *pos != '\n' && *pos != '\r' && *pos != '\t')
+                token[length++] = *pos++;
+            token[length] = '\0';
+            char *parsed = nullptr;
+            double result = std::strtod(token, &parsed);
+            if(!length || parsed != token + length)
+                ok = false;
+            return result;
+        }
+
+        /// @brief Пропуск n значений размера size (только для двоичных данных)
+        bool skipBinary(size_t bytes) {
+            if(static_cast<size_t>(end - pos) < bytes) {
+                ok = false;
+                return false;
+            }
+            pos += bytes;
+            return true;
+        }
+
+        const char *position() const { return pos; }
+
+    private:
+        template<typename T>
+        T read() {
+            T result;
+            if(static_cast<size_t>(end - pos) < sizeof(T)) {
+                ok = false;
+                return T();
+            }
+            std::memcpy(&result, pos, sizeof(T));
+            pos += sizeof(T);
+            return swap ? swapBytes(result) : result;
+        }
+
+        double binaryValue(Type type) {
+            switch(type) {
+                case Type::Int8:    return read<int8_t>();
+                case Type::UInt8:   return read<uint8_t>();
+                case Type::Int16:   return read<int16_t>();
+                case Type::UInt16:  return read<uint16_t>();
+                case Type::Int32:   return read<int32_t>();
+                case Type::UInt32:  return read<uint32_t>();
+                case Type::Float32: return read<float>();
+                case Type::Float64: return read<double>();
+                default:            ok = false; return 0.0;
+            }
+        }
+
+    private:
+        const char *pos;
+        const char *end;
+        bool binary;
+        bool swap;
+        bool ok = true;
+    };
+
+    bool isIndexList(const Property &property) {
+        return property.list && (property.name == "vertex_indices" || property.name == "vertex_index");
+    }
+
+    bool readVertices(Reader &reader, const Element &element, PLY_IO::Mesh &mesh, bool binary, bool swap) {
+        int axis[3] = {-1, -1, -1};
+        size_t stride = 0;
+        bool fixed = true;
+        for(size_t i = 0; i != element.properties.size(); ++i) {
+            const Property &property = element.properties[i];
+            if(property.name == "x") axis[0] = static_cast<int>(i);
+            if(property.name == "y") axis[1] = static_cast<int>(i);
+            if(property.name == "z") axis[2] = static_cast<int>(i);
+            fixed = fixed && !property.list;
+            stride += typeSize(property.type);
+        }
+        if(axis[0] < 0 || axis[1] < 0 || axis[2] < 0)
+            return false;
+
+        mesh.points.resize(element.count * 3);
+        // Частый случай: только x, y, z в float32 - копирование одним блоком
+        if(binary && !swap && fixed && element.properties.size() == 3 && stride == 3 * sizeof(float) &&
+           axis[0] == 0 && axis[1] == 1 && axis[2] == 2 &&
+           element.properties[0].type == Type::Float32 &&
+           element.properties[1].type == Type::Float32 &&
+           element.properties[2].type == Type::Float32) {
+            const char *begin = reader.position();
+            if(!reader.skipBinary(element.count * stride))
+                return false;
+            std::memcpy(mesh.points.data(), begin, element.count * stride);
+            return true;
+        }
+
+        for(size_t v = 0; v != element.count; ++v) {
+            for(size_t i = 0; i != element.properties.size(); ++i) {
+                const Property &property = element.properties[i];
+                size_t length = property.list ? static_cast<size_t>(reader.value(property.count_type)) : 1;
+                for(size_t k = 0; k != length; ++k) {
+                    double value = reader.value(property.type);
+                    for(int a = 0; a != 3; ++a)
+                        if(axis[a] == static_cast<int>(i))
+                            mesh.points[3 * v + a] = static_cast<float>(value);
+                }
+            }
+            if(!reader.good())
+                return false;
+        }
+        return true;
+    }
+
+    bool readFaces(Reader &reader, const Element &element, PLY_IO::Mesh &mesh) {
+        mesh.polygons.reserve(element.count * 4);
+        const int32_t points = static_cast<int32_t>(mesh.numberOfPoints());
+        for(size_t f = 0; f != element.count; ++f) {
+            for(const Property &property: element.properties) {
+                size_t length = property.list ? static_cast<size_t>(reader.value(property.count_type)) : 1;
+                const bool indices = isIndexList(property);
+                if(indices)
+                    mesh.polygons.push_back(static_cast<int32_t>(length));
+                for(size_t k = 0; k != length; ++k) {
+                    double value = reader.value(property.type);
+                    if(!indices)
+                        continue;
+                    int32_t id = static_cast<int32_t>(value);
+                    if(id < 0 || id >= points)
+                        return false;
+                    mesh.polygons.push_back(id);
+                }
+                if(indices)
+                    ++mesh.faces;
+            }
+            if(!reader.good())
+                return false;
+        }
+        return true;
+    }
+
+    /// @brief Полигоны из массивов смещений и связности vtkCellArray (VTK 9)
+    template<typename Offsets, typename Connectivity>
+    void appendPolygons(const Offsets *offsets, vtkIdType cells, const Connectivity *connectivity,
+                        PLY_IO::Mesh &mesh) {
+        mesh.polygons.reserve(mesh.polygons.size() + static_cast<size_t>(cells + offsets[cells]));
+        for(vtkIdType c = 0; c != cells; ++c) {
+            mesh.polygons.push_back(static_cast<int32_t>(offsets[c + 1] - offsets[c]));
+            for(auto id = offsets[c]; id != offsets[c + 1]; ++id)
+                mesh.polygons.push_back(static_cast<int32_t>(connectivity[id]));
+        }
+        mesh.faces += static_cast<size_t>(cells);
+    }
+
+    void skipElement(Reader &reader, const Element &element) {
+        for(size_t e = 0; e != element.count && reader.good(); ++e)
+            for(const Property &property: element.properties) {
+                size_t length = property.list ? static_cast<size_t>(reader.value(property.count_type)) : 1;
+                for(size_t k = 0; k != length; ++k)
+                    reader.value(property.type);
+            }
+    }
+}
+
+PLY_IO::Format PLY_IO::defaultFormat() {
+    const char *format = std::getenv("VTK_VIEWER_PLY_FORMAT");
+    if(format && std::string(format) == "ascii")
+        return Format::Ascii;
+    return Format::Binary;
+}
+
+bool PLY_IO::writeCloud(const std::string &path, const std::vector<cv::Point3f> &cloud, Format format) {
+    return writePly(path, reinterpret_cast<const float*>(cloud.data()), cloud.size(),
+                    nullptr, 0, 0, format);
+}
+
+bool PLY_IO::writeMesh(const std::string &path, const Mesh &mesh, Format format) {
+    return writePly(path, mesh.points.data(), mesh.numberOfPoints(),
+                    mesh.polygons.data(), mesh.polygons.size(), mesh.faces, format);
+}
+
+bool PLY_IO::writeMesh(const std::string &path, vtkPolyData *data, Format format) {
+    if(!data)
+        return false;
+    return writeMesh(path, fromPolyData(data), format);
+}
+
+bool PLY_IO::readMesh(const std::string &path, Mesh &mesh) {
+    FILE_IO::MappedFile file(path);
+    if(!file.data())
+        return false;
+
+    bool binary = false;
+    std::vector<Element> elements;
+    size_t body = 0;
+    if(!parseHeader(file.data(), file.size(), binary, elements, body)) {
+        std::cerr << "Error: unsupported PLY header in " << path << std::endl;
+        return false;
+    }
+
+    mesh = Mesh();
+    const bool swap = binary && !littleEndian();
+    Reader reader(file.data() + body, file.data() + file.size(), binary, swap);
+    bool vertices_read = false;
+    for(const Element &element: elements) {
+        bool ok = true;
+        if(element.name == "vertex") {
+            ok = readVertices(reader, element, mesh, binary, swap);
+            vertices_read = ok;
+        } else if(element.name == "face" && vertices_read) {
+            ok = readFaces(reader, element, mesh);
+        } else {
+            skipElement(reader, element);
+        }
+        if(!ok || !reader.good()) {
+            std::cerr << "Error: cannot read PLY element " << element.name << " from " << path << std::endl;
+            return false;
+        }
+    }
+    return vertices_read;
+}
+
+vtkSmartPointer<vtkPolyData> PLY_IO::readPolyData(const std::string &path) {
+    Mesh mesh;
+    if(!readMesh(path, mesh))
+        return nullptr;
+    return toPolyData(mesh);
+}
+
+PLY_IO::Mesh PLY_IO::fromPolyData(vtkPolyData *data) {
+    Mesh mesh;
+    const vtkIdType count = data->GetNumberOfPoints();
+    mesh.points.resize(static_cast<size_t>(count) * 3);
+    // Точки во float (обычный случай) копируются одним блоком, без GetPoint на каждую
+    vtkDataArray *coords = count ? data->GetPoints()->GetData() : nullptr;
+    if(vtkFloatArray *floats = vtkFloatArray::FastDownCast(coords)) {
+        std::memcpy(mesh.points.data(), floats->GetPointer(0), mesh.points.size() * sizeof(float));
+    } else {
+        for(vtkIdType i = 0; i != count; ++i) {
+            double point[3];
+            data->GetPoint(i, point);
+            mesh.points[3 * i + 0] = static_cast<float>(point[0]);
+            mesh.points[3 * i + 1] = static_cast<float>(point[1]);
+            mesh.points[3 * i + 2] = static_cast<float>(point[2]);
+        }
+    }
+
+    // Связность читается прямо из массивов vtkCellArray, без обхода через vtkIdList
+    vtkCellArray *cells = data->GetPolys();
+    if(!cells)
+        return mesh;
+#if VTK_MAJOR_VERSION >= 9
+    const vtkIdType num_cells = cells->GetNumberOfCells();
+    if(cells->IsStorage64Bit())
+        appendPolygons(cells->GetOffsetsArray64()->GetPointer(0), num_cells,
+                       cells->GetConnectivityArray64()->GetPointer(0), mesh);
+    else
+        appendPolygons(cells->GetOffsetsArray32()->GetPointer(0), num_cells,
+                       cells->GetConnectivityArray32()->GetPointer(0), mesh);
+#else
+    // Старый формат: [n, id_0 .. id_n-1] подряд, как и в Mesh
+    const vtkIdType *legacy = cells->GetPointer();
+    const vtkIdType entries = cells->GetNumberOfConnectivityEntries();
+    mesh.polygons.resize(static_cast<size_t>(entries));
+    for(vtkIdType i = 0; i != entries; ++i)
+        mesh.polygons[i] = static_cast<int32_t>(legacy[i]);
+    mesh.faces = static_cast<size_t>(cells->GetNumberOfCells());
+#endif
+    return mesh;
+}
+
+vtkSmartPointer<vtkPolyData> PLY_IO::toPolyData(const Mesh &mesh) {
+    vtkNew<vtkFloatArray> coords;
+    coords->SetNumberOfComponents(3);
+    coords->SetNumberOfTuples(static_cast<vtkIdType>(mesh.numberOfPoints()));
+    if(!mesh.points.empty())
+        std::memcpy(coords->GetVoidPointer(0), mesh.points.data(), mesh.points.size() * sizeof(float));
+    vtkNew<vtkPoints> points;
+    points->SetData(coords);
+
+    // Связность заполняется целыми массивами и передается в vtkCellArray одним вызовом
+    vtkNew<vtkCellArray> polys;
+    const int32_t *polygons = mesh.polygons.data();
+    const size_t total = mesh.polygons.size();
+#if VTK_MAJOR_VERSION >= 9
+    vtkNew<vtkTypeInt32Array> offsets;
+    vtkNew<vtkTypeInt32Array> connectivity;
+    offsets->SetNumberOfValues(static_cast<vtkIdType>(mesh.faces + 1));
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(total >= mesh.faces ? total - mesh.faces : 0));
+    int32_t *offset = offsets->GetPointer(0);
+    int32_t *ids = connectivity->GetPointer(0);
+    size_t pos = 0, face = 0, count = 0;
+    offset[0] = 0;
+    for(; face != mesh.faces && pos < total; ++face) {
+        const size_t n = static_cast<size_t>(std::max<int32_t>(polygons[pos++], 0));
+        if(pos + n > total)
+            break;
+        std::memcpy(ids + count, polygons + pos, n * sizeof(int32_t));
+        count += n;
+        pos += n;
+        offset[face + 1] = static_cast<int32_t>(count);
+    }
+    // Обрезанный список полигонов: остаются только прочитанные целиком
+    offsets->SetNumberOfValues(static_cast<vtkIdType>(face + 1));
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(count));
+    polys->SetData(offsets, connectivity);
+#else
+    // Старый формат vtkCellArray совпадает с Mesh: [n, id_0 .. id_n-1] подряд
+    vtkNew<vtkIdTypeArray> connectivity;
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(total));
+    vtkIdType *ids = connectivity->GetPointer(0);
+    size_t pos = 0, face = 0;
+    for(; face != mesh.faces && pos < total; ++face) {
+        const size_t n = static_cast<size_t>(std::max<int32_t>(polygons[pos], 0));
+        if(pos + 1 + n > total)
+            break;
+        ids[pos++] = static_cast<vtkIdType>(n);
+        for(size_t end = pos + n; pos != end; ++pos)
+            ids[pos] = polygons[pos];
+    }
+    // Обрезанный список полигонов: остаются только прочитанные целиком
+    connectivity->SetNumberOfValues(static_cast<vtkIdType>(pos));
+    polys->SetCells(static_cast<vtkIdType>(face), connectivity);
+#endif
+
+    auto data = vtkSmartPointer<vtkPolyData>::New();
+    data->SetPoints(points);
+    data->SetPolys(polys);
+    return data;
+}
@@ -0,0 +1,61 @@
+#ifndef PLY_IO_HPP
+#define PLY_IO_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+
+/// Запись и чтение облаков точек и моделей в формате PLY.
+/// По умолчанию пишется binary_little_endian: вершины уходят в файл одним блоком,
+/// грани - крупными порциями, без форматирования чисел. ASCII остается доступен
+/// (параметр format или $VTK_VIEWER_PLY_FORMAT=ascii). Чтение поддерживает оба
+/// варианта; двоичный файл отображается в память (mmap)
+namespace PLY_IO {
+    /// Формат файла
+    enum class Format {
+        Binary,     /// binary_little_endian 1.0
+        Ascii       /// ascii 1.0
+    };
+
+    /// Полигональная модель: точки (x, y, z подряд) и полигоны
+    /// в виде [n, id_0 .. id_n-1] подряд (после заливки дыр бывают не только треугольники)
+    struct Mesh {
+        std::vector<float> points;
+        std::vector<int32_t> polygons;
+        size_t faces = 0;               /// Количество полигонов
+
+        size_t numberOfPoints() const { return points.size() / 3; }
+    };
+
+    /// @brief Формат записи по умолчанию: ascii, если $VTK_VIEWER_PLY_FORMAT=ascii, иначе двоичный
+    Format defaultFormat();
+
+    /// @brief Записывает облако точек (только вершины)
+    /// @return false при ошибке записи
+    bool writeCloud(const std::string &path, const std::vector<cv::Point3f> &cloud,
+                    Format format = defaultFormat());
+
+    /// @brief Записывает модель
+    /// @return false при ошибке записи
+    bool writeMesh(const std::string &path, const Mesh &mesh, Format format = defaultFormat());
+    bool writeMesh(const std::string &path, vtkPolyData *data, Format format = defaultFormat());
+
+    /// @brief Читает модель или облако (ascii или binary_little_endian)
+    /// @return false, если файл не прочитан или не поддерживается
+    bool readMesh(const std::string &path, Mesh &mesh);
+
+    /// @brief Читает модель сразу в vtkPolyData
+    /// @return nullptr, если файл не прочитан
+    vtkSmartPointer<vtkPolyData> readPolyData(const std::string &path);
+
+    /// @brief Перевод между Mesh и vtkPolyData (копирование)
+    Mesh fromPolyData(vtkPolyData *data);
+    vtkSmartPointer<vtkPolyData> toPolyData(const Mesh &mesh);
+}
+
+
+#endif //PLY_IO_HPP
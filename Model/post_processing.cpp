@@ -1,14 +1,26 @@
 #include "post_processing.hpp"
+#include "mesh_export.hpp"
+#include "parallel.hpp"
+#include "ply_io.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
 
 // Post-processing
 #include <vtkNew.h>
 #include <vtkNamedColors.h>
-#include <vtkPLYReader.h>
+#include <vtkSMPTools.h>
+#include <vtkPolyDataAlgorithm.h>
 #include <vtkSmoothPolyDataFilter.h>
+#include <vtkWindowedSincPolyDataFilter.h>
 #include <vtkFillHolesFilter.h>
 #include <vtkPolyDataConnectivityFilter.h>
-#include <vtkPLYWriter.h>
-#include <vtkSTLWriter.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkTriangleFilter.h>
 
 // Visualise
 #include <vtkPolyDataMapper.h>
@@ -21,143 +33,247 @@
 
 
 namespace {
+    using Clock = std::chrono::steady_clock;
+    using Kind = VTK_POSTPROCESSING::Stage::Kind;
+
+    /// Названия этапов в порядке Kind (строковые литералы - годятся и для трассировки)
+    const char *const STAGE_NAMES[] = {"smooth", "sinc", "holes", "largest_region", "normals", "decimate"};
+
+    const char *stage_name(Kind kind) {
+        return STAGE_NAMES[static_cast<int>(kind)];
+    }
+
+    /// @brief Фильтр VTK для этапа
+    vtkSmartPointer<vtkPolyDataAlgorithm> make_filter(const VTK_POSTPROCESSING::Stage &stage);
+
+    /// @brief Разбирает один этап вида name или name=args (без args - значения по умолчанию)
+    bool parse_stage(const std::string &item, VTK_POSTPROCESSING::Stage &stage);
+
     void visualise_model(vtkPolyData *data);
-    void save_to_dae(vtkPolyData *data,
-                     const std::string &model_directory,
-                     const std::string &fileName);
-    void save_to_ply(vtkPolyData* data,
-                     const std::string &model_directory,
-                     const std::string &filename);
-    void save_to_stl(vtkPolyData* data,
-                     const std::string &model_directory,
-                     const std::string &filename);
 }
 
 vtkSmartPointer<vtkPolyData> VTK_POSTPROCESSING::postprocess(const std::string &model_directory,
                                                              const std::string &filename,
                                                              bool visualise) {
-    vtkNew<vtkPLYReader> reader;
-    reader->SetFileName((model_directory + "/" + filename + ".ply").c_str());
-    reader->Update();
-
-    vtkNew<vtkSmoothPolyDataFilter> smooth;
-    smooth->SetInputData(reader->GetOutput());
-    smooth->SetNumberOfIterations(25);
-    smooth->SetRelaxationFactor(0.1);
-    smooth->FeatureEdgeSmoothingOff();
-    smooth->BoundarySmoothingOn();
-    smooth->Update();
-
-    vtkNew<vtkFillHolesFilter> fill_holes;
-    fill_holes->SetInputData(smooth->GetOutput());
-    fill_holes->SetHoleSize(100000.0);
-    fill_holes->Update();
-
-    vtkNew<vtkPolyDataConnectivityFilter> confilter;
-    confilter->SetInputData(fill_holes->GetOutput());
-    confilter->SetExtractionModeToLargestRegion();
-    confilter->Update();
-
-    vtkNew<vtkPolyData> poly_data;
-    poly_data->DeepCopy(confilter->GetOutput());
-
-    save_to_dae(poly_data, model_directory, filename);
-    save_to_ply(poly_data, model_directory, filename);
-    
-    if(visualise) {
-        vtkNew<vtkPolyData> polyDataTest;
-        polyDataTest->ShallowCopy(poly_data);
+    vtkSmartPointer<vtkPolyData> model = PLY_IO::readPolyData(model_directory + "/" + filename + ".ply");
+    if(!model)
+        throw std::runtime_error("cannot read model " + model_directory + "/" + filename + ".ply");
+
+    vtkSmartPointer<vtkPolyData> poly_data = postprocess(model);
+    exportModel(poly_data, model_directory, filename);
+    if(visualise)
         visualise_model(poly_data);
+    return poly_data;
+}
+
+vtkSmartPointer<vtkPolyData> VTK_POSTPROCESSING::postprocess(vtkPolyData *model,
+                                                             const Pipeline &stages,
+                                                             std::vector<StageReport> *report) {
+    TRACE_SCOPE("postprocessing");
+    // Параллельные фильтры VTK (vtkSMPTools) используют то же число потоков, что и остальной конвейер
+    vtkSMPTools::Initialize(static_cast<int>(PARALLEL::threads()));
+
+    // Каждый этап получает результат предыдущего поверхностной копией:
+    // массивы точек и ячеек общие, копируются только заголовки
+    auto current = vtkSmartPointer<vtkPolyData>::New();
+    current->ShallowCopy(model);
+    for(const Stage &stage: stages) {
+        const char *name = stage_name(stage.kind);
+        TRACE::Scope trace(name);
+        auto start = Clock::now();
+        vtkSmartPointer<vtkPolyDataAlgorithm> filter = make_filter(stage);
+        // vtkQuadricDecimation принимает только треугольники, а заливка дыр оставляет многоугольники
+        vtkNew<vtkTriangleFilter> triangulate;
+        if(stage.kind == Kind::Decimate) {
+            triangulate->SetInputData(current);
+            filter->SetInputConnection(triangulate->GetOutputPort());
+        } else {
+            filter->SetInputData(current);
+        }
+        filter->Update();
+        auto next = vtkSmartPointer<vtkPolyData>::New();
+        next->ShallowCopy(filter->GetOutput());
+        current = next;
+
+        StageReport stage_report;
+        stage_report.name = name;
+        stage_report.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        stage_report.points = current->GetNumberOfPoints();
+        stage_report.cells = current->GetNumberOfCells();
+        std::cout << "Postprocessing " << name << ": " << stage_report.ms << " ms, "
+                  << stage_report.points << " points, " << stage_report.cells << " cells" << std::endl;
+        if(report)
+            report->push_back(stage_report);
     }
+    return current;
+}
 
-    return poly_data;
+VTK_POSTPROCESSING::Pipeline VTK_POSTPROCESSING::defaultPipeline() {
+    return {{Stage::Kind::Smooth, 25, 0.1},
+            {Stage::Kind::FillHoles, 0, 100000.0},
+            {Stage::Kind::LargestRegion, 0, 0.0}};
 }
 
-namespace {
-    void save_to_dae(vtkPolyData *data,
-                     const std::string &model_directory,
-                     const std::string &fileName) {
-        std::ofstream outputFile(model_directory + "/" + fileName + ".dae");
-
-        outputFile << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-                      "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n"
-                      "  <asset>\n"
-                      "    <contributor>\n"
-                      "      <author>MRobot</author>\n"
-                      "    </contributor>\n"
-                      "    <up_axis>Z_UP</up_axis>\n"
-                      "  </asset>\n"
-                      "\n"
-                      "  <library_geometries>\n"
-                      "    <geometry id=\"head_mesh\" name=\"head\">\n"
-                      "      <mesh>\n"
-                      "        <source id=\"mesh_points\">\n"
-                      "          <float_array name=\"values\" count=\"";
-
-        outputFile << data->GetNumberOfPoints() * 3 << "\">\n            ";
-
-        for(auto i = 0; i != data->GetNumberOfPoints(); ++i) {
-            double *point;
-            point = data->GetPoint(i);
-            outputFile << point[0] << " " << point[1] << " " << point[2] << "\n            ";
+VTK_POSTPROCESSING::Pipeline VTK_POSTPROCESSING::pipeline() {
+    static const Pipeline configured = [] {
+        Pipeline result = defaultPipeline();
+        const char *value = std::getenv("VTK_VIEWER_POSTPROCESS");
+        if(value && !parsePipeline(value, result))
+            std::cerr << "Warning: cannot parse VTK_VIEWER_POSTPROCESS=" << value
+                      << ", default postprocessing is used" << std::endl;
+        return result;
+    }();
+    return configured;
+}
+
+bool VTK_POSTPROCESSING::parsePipeline(const std::string &text, Pipeline &pipeline) {
+    Pipeline result;
+    if(text != "none") {
+        std::stringstream stream(text);
+        std::string item;
+        while(std::getline(stream, item, ',')) {
+            Stage stage{Stage::Kind::Smooth};
+            if(!parse_stage(item, stage))
+                return false;
+            result.push_back(stage);
         }
+        if(result.empty())
+            return false;
+    }
+    pipeline = std::move(result);
+    return true;
+}
 
-        outputFile << "          </float_array>\n"
-                      "          <technique_common>\n"
-                      "            <accessor source=\"#values\" count=\"";
-        outputFile << data->GetNumberOfPoints() << "\" stride=\"3\">\n"
-                      "              <param name=\"X\" type=\"float\"/>\n"
-                      "              <param name=\"Y\" type=\"float\"/>\n"
-                      "              <param name=\"Z\" type=\"float\"/>\n"
-                      "            </accessor>\n"
-                      "          </technique_common>\n"
-                      "        </source>\n"
-                      "\n"
-                      "        <triangles count=\"";
-        outputFile << data->GetNumberOfCells() << "\">\n";
-        outputFile << "          <input semantic=\"POSITION\" source=\"#mesh_points\" offset=\"0\"/>\n"
-                      "          <p>\n";
-
-        vtkNew<vtkIdList> idL;
-        data->GetPolys()->InitTraversal();
-        while(data->GetPolys()->GetNextCell(idL))
-            outputFile << "            " << idL->GetId(0) << " " << idL->GetId(1) << " " << idL->GetId(2) << "\n";
-
-        outputFile << "        </p>\n"
-                      "        </triangles>\n"
-                      "      </mesh>\n"
-                      "    </geometry>\n"
-                      "  </library_geometries>\n"
-                      "\n"
-                      "  <library_visual_scenes>\n"
-                      "    <visual_scene id=\"Scene\" name=\"Scene\">\n"
-                      "      <node id=\"head_model\" name=\"Head_model\" type=\"NODE\">\n"
-                      "        <instance_geometry url=\"#head_mesh\" name=\"head_geometry\"/>\n"
-                      "      </node>\n"
-                      "    </visual_scene>\n"
-                      "  </library_visual_scenes>\n"
-                      "  \n"
-                      "</COLLADA>";
+std::string VTK_POSTPROCESSING::describe(const Pipeline &pipeline) {
+    if(pipeline.empty())
+        return "none";
+    std::ostringstream text;
+    for(size_t i = 0; i != pipeline.size(); ++i) {
+        const Stage &stage = pipeline[i];
+        if(i)
+            text << ",";
+        text << stage_name(stage.kind);
+        switch(stage.kind) {
+            case Stage::Kind::Smooth:
+            case Stage::Kind::WindowedSinc:
+                text << "=" << stage.iterations << "/" << stage.value;
+                break;
+            case Stage::Kind::LargestRegion:
+                break;
+            default:
+                text << "=" << stage.value;
+        }
     }
+    return text.str();
+}
+
+void VTK_POSTPROCESSING::exportModel(vtkPolyData *model,
+                                     const std::string &model_directory,
+                                     const std::string &filename) {
+    MESH_EXPORT::write(PLY_IO::fromPolyData(model), model_directory, filename);
+}
 
-    void save_to_ply(vtkPolyData* data,
-                     const std::string &model_directory,
-                     const std::string &filename) {
-        vtkNew<vtkPLYWriter> writer;
-        writer->SetInputData(data);
-        writer->SetFileName((model_directory + "/" + filename + ".ply").c_str());
-        writer->Update();
+void VTK_POSTPROCESSING::visualise(vtkPolyData *model) {
+    visualise_model(model);
+}
+
+namespace {
+    vtkSmartPointer<vtkPolyDataAlgorithm> make_filter(const VTK_POSTPROCESSING::Stage &stage) {
+        switch(stage.kind) {
+            case Kind::Smooth: {
+                auto smooth = vtkSmartPointer<vtkSmoothPolyDataFilter>::New();
+                smooth->SetNumberOfIterations(stage.iterations);
+                smooth->SetRelaxationFactor(stage.value);
+                smooth->FeatureEdgeSmoothingOff();
+                smooth->BoundarySmoothingOn();
+                return smooth;
+            }
+            case Kind::WindowedSinc: {
+                // Сходится за меньшее число итераций и почти не сжимает модель
+                auto sinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+                sinc->SetNumberOfIterations(stage.iterations);
+                sinc->SetPassBand(stage.value);
+                sinc->NormalizeCoordinatesOn();
+                sinc->FeatureEdgeSmoothingOff();
+                sinc->BoundarySmoothingOn();
+                sinc->NonManifoldSmoothingOn();
+                return sinc;
+            }
+            case Kind::FillHoles: {
+                auto fill_holes = vtkSmartPointer<vtkFillHolesFilter>::New();
+                fill_holes->SetHoleSize(stage.value);
+                return fill_holes;
+            }
+            case Kind::LargestRegion: {
+                auto confilter = vtkSmartPointer<vtkPolyDataConnectivityFilter>::New();
+                confilter->SetExtractionModeToLargestRegion();
+                return confilter;
+            }
+            case Kind::Normals: {
+                // Без разбиения по острым ребрам: число вершин не меняется
+                auto normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+                normals->SetFeatureAngle(stage.value);
+                normals->SplittingOff();
+                normals->ConsistencyOn();
+                normals->ComputePointNormalsOn();
+                normals->ComputeCellNormalsOff();
+                return normals;
+            }
+            case Kind::Decimate: {
+                auto decimate = vtkSmartPointer<vtkQuadricDecimation>::New();
+                decimate->SetTargetReduction(stage.value);
+                decimate->VolumePreservationOn();
+                return decimate;
+            }
+        }
+        throw std::invalid_argument("unknown postprocessing stage");
     }
 
-    // Эта падла занимает более чем в 15 раз больше места
-    void save_to_stl(vtkPolyData* data,
-                     const std::string &model_directory,
-                     const std::string &filename) {
-        vtkNew<vtkSTLWriter> writer;
-        writer->SetInputData(data);
-        writer->SetFileTypeToASCII();
-        writer->SetFileName((model_directory + "/" + filename + ".stl").c_str());
-        writer->Update();
+    bool parse_stage(const std::string &item, VTK_POSTPROCESSING::Stage &stage) {
+        const size_t equal = item.find('=');
+        const std::string name = item.substr(0, equal);
+        const std::string args = equal == std::string::npos ? std::string() : item.substr(equal + 1);
+
+        // Значения по умолчанию, если аргументы не заданы
+        if(name == "smooth")
+            stage = {Kind::Smooth, 25, 0.1};
+        else if(name == "sinc")
+            stage = {Kind::WindowedSinc, 15, 0.1};
+        else if(name == "holes")
+            stage = {Kind::FillHoles, 0, 100000.0};
+        else if(name == "largest_region")
+            stage = {Kind::LargestRegion, 0, 0.0};
+        else if(name == "normals")
+            stage = {Kind::Normals, 0, 60.0};
+        else if(name == "decimate")
+            stage = {Kind::Decimate, 0, 0.5};
+        else
+            return false;
+        if(args.empty())
+            return equal == std::string::npos;
+        if(stage.kind == Kind::LargestRegion)
+            return false;
+
+        size_t used = 0;
+        try {
+            if(stage.kind == Kind::Smooth || stage.kind == Kind::WindowedSinc) {
+                const size_t slash = args.find('/');
+                stage.iterations = std::stoi(args.substr(0, slash), &used);
+                if(used != args.substr(0, slash).size() || stage.iterations < 1)
+                    return false;
+                if(slash == std::string::npos)
+                    return true;
+                const std::string value = args.substr(slash + 1);
+                stage.value = std::stod(value, &used);
+                return used == value.size() && stage.value > 0.0;
+            }
+            stage.value = std::stod(args, &used);
+        } catch(const std::exception &) {
+            return false;
+        }
+        if(used != args.size() || stage.value < 0.0)
+            return false;
+        return stage.kind != Kind::Decimate || stage.value < 1.0;
     }
 
     void visualise_model(vtkPolyData *data) {
@@ -2,13 +2,78 @@
 #define VTK_POST_PROCESSING
 
 #include <string>
+#include <vector>
 #include <vtkPolyData.h>
 
 
 namespace VTK_POSTPROCESSING {
+    /// Этап постобработки
+    struct Stage {
+        enum class Kind {
+            Smooth,         /// vtkSmoothPolyDataFilter (лапласиан): iterations, value - релаксация
+            WindowedSinc,   /// vtkWindowedSincPolyDataFilter: iterations, value - полоса пропускания
+            FillHoles,      /// vtkFillHolesFilter: value - размер дыры
+            LargestRegion,  /// vtkPolyDataConnectivityFilter, наибольшая компонента
+            Normals,        /// vtkPolyDataNormals: value - угол ребра, град. Параллельно через
+                            /// vtkSMPTools только в VTK 9.1 и новее, в VTK 8.2 последовательно
+            Decimate        /// vtkQuadricDecimation после vtkTriangleFilter (заливка дыр дает
+                            /// многоугольники): value - доля удаляемых треугольников
+        };
+
+        Kind kind;
+        int iterations = 0;
+        double value = 0.0;
+    };
+
+    /// Последовательность этапов, выполняемых по порядку
+    using Pipeline = std::vector<Stage>;
+
+    /// Замер одного выполненного этапа
+    struct StageReport {
+        std::string name;
+        double ms = 0.0;            /// Время выполнения
+        vtkIdType points = 0;       /// Вершин после этапа
+        vtkIdType cells = 0;        /// Полигонов после этапа
+    };
+
+    /// @brief Этапы по умолчанию: smooth=25/0.1,holes=100000,largest_region
+    Pipeline defaultPipeline();
+
+    /// @brief Этапы, заданные $VTK_VIEWER_POSTPROCESS, иначе defaultPipeline()
+    Pipeline pipeline();
+
+    /// @brief Разбирает список этапов через запятую: smooth=N/F, sinc=N/F, holes=S,
+    /// largest_region, normals=A, decimate=R
+    /// @return false, если строка не разобрана (pipeline не изменяется)
+    bool parsePipeline(const std::string &text, Pipeline &pipeline);
+
+    /// @brief Запись этапов в том же виде, что принимает parsePipeline (для ключа кэша)
+    std::string describe(const Pipeline &pipeline);
+
+    /// @brief Постобработка модели из файла <model_directory>/<filename>.ply
+    /// с сохранением результата рядом (DAE, PLY, STL)
     vtkSmartPointer<vtkPolyData> postprocess(const std::string &model_directory,
                                              const std::string &filename,
                                              bool visualise);
+
+    /// @brief Постобработка модели в памяти. Этапы передают друг другу результат
+    /// без глубокого копирования
+    /// @param model Исходная модель (не изменяется)
+    /// @param stages Этапы постобработки
+    /// @param report Если задан, сюда добавляются замеры этапов
+    /// @return Новая модель
+    vtkSmartPointer<vtkPolyData> postprocess(vtkPolyData *model,
+                                             const Pipeline &stages = pipeline(),
+                                             std::vector<StageReport> *report = nullptr);
+
+    /// @brief Сохраняет модель в <model_directory>/<filename>.dae, .ply и .stl
+    /// (форматы пишутся параллельно, см. MESH_EXPORT::write)
+    void exportModel(vtkPolyData *model,
+                     const std::string &model_directory,
+                     const std::string &filename);
+
+    /// @brief Показывает модель в отдельном окне (блокирует до закрытия)
+    void visualise(vtkPolyData *model);
 }
 
 
@@ -0,0 +1,246 @@
+#include "segmentation.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+#include <cmath>
+
+
+namespace {
+    /// Ширина блока столбцов при обработке вдоль нормали
+    constexpr int BLOCK = 4096;
+    /// Меньшие сигмы вдоль нормали не дают заметного сглаживания
+    constexpr double MIN_SIGMA = 0.5;
+
+    /// Объем как двумерная матрица: строка - срез целиком, столбец - линия вдоль нормали
+    cv::Mat flat(SEGMENTATION::Mask &volume) {
+        return cv::Mat(volume.slices, volume.rows * volume.cols, CV_8UC1, volume.voxels.data());
+    }
+
+    SEGMENTATION::Mask like(const SEGMENTATION::Mask &volume) {
+        SEGMENTATION::Mask result;
+        result.cols = volume.cols;
+        result.rows = volume.rows;
+        result.slices = volume.slices;
+        result.voxels.resize(volume.voxels.size());
+        return result;
+    }
+
+    template<typename Func>
+    void forEachSlice(SEGMENTATION::Mask &volume, Func func) {
+        PARALLEL::parallel_for(static_cast<size_t>(volume.slices), [&](size_t k) {
+            cv::Mat slice = volume.slice(k);
+            func(slice);
+        });
+    }
+
+    /// @brief Обработка вдоль нормали: func(src, dst) для блоков столбцов плоского вида
+    template<typename Func>
+    void forEachBlock(SEGMENTATION::Mask &src, SEGMENTATION::Mask &dst, Func func) {
+        cv::Mat src_flat = flat(src);
+        cv::Mat dst_flat = flat(dst);
+        const int width = src_flat.cols;
+        const size_t blocks = static_cast<size_t>((width + BLOCK - 1) / BLOCK);
+        PARALLEL::parallel_for(blocks, [&](size_t b) {
+            cv::Range range(static_cast<int>(b) * BLOCK, std::min(width, static_cast<int>(b + 1) * BLOCK));
+            cv::Mat dst_block = dst_flat(cv::Range::all(), range);
+            func(src_flat(cv::Range::all(), range), dst_block);
+        });
+    }
+
+    /// @brief Расширяет фон среза k от затравок (4-связность в плоскости).
+    /// Затравки - фоновые вокселы на краях среза (при first) и фоновые вокселы,
+    /// у которых сосед по нормали уже отнесен к фону
+    /// @return true, если добавлен хотя бы один воксел
+    bool floodSlice(const SEGMENTATION::Mask &volume, std::vector<uint8_t> &outside,
+                    size_t k, bool first, std::vector<int> &queue) {
+        const int rows = volume.rows;
+        const int cols = volume.cols;
+        const size_t area = static_cast<size_t>(rows) * cols;
+        const uint8_t *voxels = volume.voxels.data() + k * area;
+        uint8_t *current = outside.data() + k * area;
+        const uint8_t *below = k > 0 ? current - area : nullptr;
+        const uint8_t *above = k + 1 < static_cast<size_t>(volume.slices) ? current + area : nullptr;
+
+        queue.clear();
+        auto seed = [&](int index) {
+            if(!voxels[index] && !current[index]) {
+                current[index] = 1;
+                queue.push_back(index);
+            }
+        };
+        if(first) {
+            for(int col = 0; col != cols; ++col) {
+                seed(col);
+                seed((rows - 1) * cols + col);
+            }
+            for(int row = 0; row != rows; ++row) {
+                seed(row * cols);
+                seed(row * cols + cols - 1);
+            }
+        }
+        if(below || above) {
+            for(int index = 0; index != static_cast<int>(area); ++index)
+                if((below && below[index]) || (above && above[index]))
+                    seed(index);
+        }
+        if(queue.empty())
+            return false;
+
+        for(size_t head = 0; head != queue.size(); ++head) {
+            const int index = queue[head];
+            const int row = index / cols;
+            const int col = index - row * cols;
+            if(col > 0)
+                seed(index - 1);
+            if(col + 1 < cols)
+                seed(index + 1);
+            if(row > 0)
+                seed(index - cols);
+            if(row + 1 < rows)
+                seed(index + cols);
+        }
+        return true;
+    }
+}
+
+cv::Mat SEGMENTATION::Mask::slice(size_t k) {
+    return cv::Mat(rows, cols, CV_8UC1, voxels.data() + k * rows * cols);
+}
+
+const cv::Mat SEGMENTATION::Mask::slice(size_t k) const {
+    return cv::Mat(rows, cols, CV_8UC1, const_cast<uint8_t*>(voxels.data()) + k * rows * cols);
+}
+
+SEGMENTATION::Mask SEGMENTATION::stack(const std::vector<cv::Mat> &images, const std::vector<size_t> &order) {
+    Mask volume;
+    if(order.empty())
+        return volume;
+    volume.rows = images[order[0]].rows;
+    volume.cols = images[order[0]].cols;
+    volume.slices = static_cast<int>(order.size());
+    volume.voxels.resize(static_cast<size_t>(volume.rows) * volume.cols * volume.slices);
+    PARALLEL::parallel_for(order.size(), [&](size_t k) {
+        cv::Mat slice = volume.slice(k);
+        images[order[k]].copyTo(slice);
+    });
+    return volume;
+}
+
+void SEGMENTATION::threshold(Mask &volume, uint8_t value, cv::ThresholdTypes type) {
+    TRACE_SCOPE("mask threshold");
+    forEachSlice(volume, [&](cv::Mat &slice) {
+        cv::threshold(slice, slice, value, 255, type);
+    });
+}
+
+void SEGMENTATION::gaussian(Mask &volume, int kernel, double sigma, double sigma_z) {
+    TRACE_SCOPE("mask gaussian");
+    forEachSlice(volume, [&](cv::Mat &slice) {
+        cv::GaussianBlur(slice, slice, cv::Size(kernel, kernel), sigma);
+    });
+    if(volume.slices < 2 || sigma_z < MIN_SIGMA)
+        return;
+
+    // Вдоль нормали - одномерное ядро по столбцам плоского вида
+    const int kernel_z = 2 * static_cast<int>(std::ceil(3.0 * sigma_z)) + 1;
+    const cv::Mat weights = cv::getGaussianKernel(kernel_z, sigma_z, CV_32F);
+    const cv::Mat identity = cv::Mat::ones(1, 1, CV_32F);
+    Mask result = like(volume);
+    forEachBlock(volume, result, [&](const cv::Mat &src, cv::Mat &dst) {
+        cv::sepFilter2D(src, dst, -1, identity, weights, cv::Point(-1, -1), 0,
+                        cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+    });
+    volume.voxels.swap(result.voxels);
+}
+
+void SEGMENTATION::morphology(Mask &volume, cv::MorphTypes op, int size, int radius_z) {
+    TRACE_SCOPE("mask morphology");
+    if(size > 0) {
+        const cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size));
+        forEachSlice(volume, [&](cv::Mat &slice) {
+            cv::morphologyEx(slice, slice, op, element);
+        });
+    }
+    if(volume.slices < 2 || radius_z <= 0)
+        return;
+
+    // Отрезок вдоль нормали: за краями объема значения не учитываются
+    const cv::Mat element_z = cv::Mat::ones(2 * radius_z + 1, 1, CV_8UC1);
+    Mask result = like(volume);
+    forEachBlock(volume, result, [&](const cv::Mat &src, cv::Mat &dst) {
+        cv::morphologyEx(src, dst, op, element_z, cv::Point(-1, -1), 1,
+                         cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::morphologyDefaultBorderValue());
+    });
+    volume.voxels.swap(result.voxels);
+}
+
+void SEGMENTATION::fillBackground(Mask &volume) {
+    if(volume.empty())
+        return;
+    TRACE_SCOPE("mask fill");
+    /// Фон растет в плоскости каждого среза и передается соседям по нормали.
+    /// Четные и нечетные срезы обрабатываются по очереди: срез читает только
+    /// соседей другой четности, поэтому параллельные заливки не пересекаются.
+    /// Проходы повторяются, пока фон не перестанет расти
+    std::vector<uint8_t> outside(volume.voxels.size(), 0);
+    bool first = true;
+    std::atomic<bool> changed{true};
+    while(changed) {
+        changed = false;
+        for(size_t parity = 0; parity != 2; ++parity) {
+            const size_t count = (static_cast<size_t>(volume.slices) + 1 - parity) / 2;
+            PARALLEL::parallel_for(count, [&](size_t j) {
+                thread_local std::vector<int> queue;
+                if(floodSlice(volume, outside, 2 * j + parity, first, queue))
+                    changed = true;
+            });
+        }
+        first = false;
+    }
+
+    const size_t area = static_cast<size_t>(volume.rows) * volume.cols;
+    PARALLEL::parallel_for(static_cast<size_t>(volume.slices), [&](size_t k) {
+        uint8_t *voxels = volume.voxels.data() + k * area;
+        const uint8_t *background = outside.data() + k * area;
+        for(size_t i = 0; i != area; ++i)
+            voxels[i] = background[i] ? 0 : 255;
+    });
+}
+
+SEGMENTATION::Mask SEGMENTATION::segment(const std::vector<cv::Mat> &images, const std::vector<size_t> &order,
+                                         const Parameters &parameters) {
+    Mask volume = stack(images, order);
+    if(volume.empty())
+        return volume;
+
+    // Размеры в плоскости переводятся в срезы по отношению расстояний
+    const double ratio = parameters.slice_spacing > 0.0f
+                       ? parameters.pixel_spacing / parameters.slice_spacing : 1.0;
+    auto radius_z = [&](int size) {
+        return static_cast<int>(std::lround(size / 2.0 * ratio));
+    };
+
+    if(parameters.ct) {
+        // Убираем шумы и дефекты изображения
+        gaussian(volume, 7, 5, 5 * ratio);
+        // Убираем все, что ниже проницаемости скальпа (кожи головы)
+        threshold(volume, parameters.threshold, cv::THRESH_BINARY);
+        // Заливка всего, что не связано с фоном вокруг головы
+        fillBackground(volume);
+    } else {
+        // Предварительная чистка шумов
+        threshold(volume, parameters.threshold, cv::THRESH_TOZERO);
+        // Убираем оставшиеся шумы и дефекты изображения
+        gaussian(volume, parameters.g_kernel, parameters.g_sigma, parameters.g_sigma * ratio);
+        // Убираем все, что ниже магнитной проницаемости скальпа (кожи головы)
+        threshold(volume, parameters.threshold, cv::THRESH_BINARY);
+        // Морфологическая операция для замыкания маски для правильной заливки
+        int close = volume.cols / 40;
+        morphology(volume, cv::MORPH_DILATE, close, radius_z(close));
+        morphology(volume, cv::MORPH_ERODE, close, radius_z(close));
+        // Заливка всего, что не связано с фоном вокруг головы
+        fillBackground(volume);
+        // Уменьшение границ, размазанных гауссовым фильтром
+        morphology(volume, cv::MORPH_ERODE, parameters.g_sigma, radius_z(parameters.g_sigma));
+    }
+    return volume;
+}
@@ -0,0 +1,72 @@
+#ifndef SEGMENTATION_HPP
+#define SEGMENTATION_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <cstdint>
+#include <vector>
+
+
+/// Объемная сегментация головы по 8-битным (выровненным) срезам.
+/// В отличие от масок по отдельным срезам, фильтры и заливка фона работают
+/// сразу по всему объему: сглаживание и морфология продолжаются вдоль нормали
+/// с учетом расстояния между срезами, а фон ищется как связная область,
+/// касающаяся боковых граней объема. Поэтому голова, касающаяся края
+/// кадра, не ломает заливку, а контуры соседних срезов согласованы.
+/// Операции выполняются параллельно: по срезам в плоскости и по блокам
+/// столбцов вдоль нормали
+namespace SEGMENTATION {
+    /// Непрерывный 8-битный объем (cols x rows x slices), срез за срезом
+    struct Mask {
+        int cols = 0;
+        int rows = 0;
+        int slices = 0;
+        std::vector<uint8_t> voxels;
+
+        bool empty() const { return voxels.empty(); }
+        /// @brief Срез k как заголовок cv::Mat без копирования
+        cv::Mat slice(size_t k);
+        const cv::Mat slice(size_t k) const;
+    };
+
+    /// Параметры сегментации
+    struct Parameters {
+        bool ct = false;                /// Исследование КТ (иначе МРТ)
+        uint8_t threshold = 0;          /// Порог кожи головы (в 8-битной шкале)
+        int g_kernel = 7;               /// Размер гауссова ядра в плоскости среза
+        int g_sigma = 5;                /// Сигма гауссова ядра в плоскости среза
+        float pixel_spacing = 1.0f;     /// Расстояние между пикселями, мм
+        float slice_spacing = 1.0f;     /// Расстояние между срезами, мм
+    };
+
+    /// @brief Собирает срезы images[order[i]] в непрерывный объем
+    Mask stack(const std::vector<cv::Mat> &images, const std::vector<size_t> &order);
+
+    /// @brief Пороговое преобразование всего объема (как cv::threshold)
+    void threshold(Mask &volume, uint8_t value, cv::ThresholdTypes type);
+
+    /// @brief Раздельное гауссово сглаживание
+    /// @param kernel Размер ядра в плоскости среза
+    /// @param sigma Сигма в плоскости среза
+    /// @param sigma_z Сигма вдоль нормали в срезах (меньше 0.5 - без сглаживания)
+    void gaussian(Mask &volume, int kernel, double sigma, double sigma_z);
+
+    /// @brief Морфология с цилиндрическим элементом: эллипс size x size
+    /// в плоскости среза и отрезок 2 * radius_z + 1 вдоль нормали
+    /// @param op cv::MORPH_DILATE или cv::MORPH_ERODE
+    void morphology(Mask &volume, cv::MorphTypes op, int size, int radius_z);
+
+    /// @brief Заливка всего, что не связано с фоном на боковых гранях объема.
+    /// Нулевые вокселы, достижимые от краев срезов (6-связность), остаются нулями,
+    /// все остальное (голова и полости внутри нее) становится 255
+    void fillBackground(Mask &volume);
+
+    /// @brief Бинарная маска головы (0 или 255)
+    /// @param images Выровненные 8-битные срезы
+    /// @param order Порядок срезов вдоль нормали
+    Mask segment(const std::vector<cv::Mat> &images, const std::vector<size_t> &order,
+                 const Parameters &parameters);
+}
+
+
+#endif //SEGMENTATION_HPP
@@ -0,0 +1,57 @@
+#include "slice_order.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+cv::Vec3f SLICE_ORDER::normal(const std::array<float, 6> &orientation) {
+    cv::Vec3f row_dir(orientation[0], orientation[1], orientation[2]);
+    cv::Vec3f col_dir(orientation[3], orientation[4], orientation[5]);
+    return row_dir.cross(col_dir);
+}
+
+SLICE_ORDER::Order SLICE_ORDER::sort(const std::vector<cv::Point3f> &positions,
+                                     const std::array<float, 6> &orientation) {
+    Order result;
+    result.normal = normal(orientation);
+    if(positions.empty())
+        return result;
+
+    std::vector<float> projections(positions.size());
+    for(size_t i = 0; i != positions.size(); ++i)
+        projections[i] = result.normal.dot(cv::Vec3f(positions[i]));
+
+    /// Сортируется только перестановка; устойчивая сортировка оставляет
+    /// первым из совпадающих срез с меньшим номером
+    std::vector<size_t> permutation(positions.size());
+    std::iota(permutation.begin(), permutation.end(), 0);
+    std::stable_sort(permutation.begin(), permutation.end(), [&](size_t a, size_t b) {
+        return projections[a] < projections[b];
+    });
+
+    for(size_t i: permutation) {
+        if(!result.projections.empty()
+           && projections[i] - result.projections.back() < DUPLICATE_TOLERANCE) {
+            result.duplicates.push_back(i);
+            continue;
+        }
+        result.order.push_back(i);
+        result.projections.push_back(projections[i]);
+    }
+
+    /// Медиана шагов устойчива к отдельным пропускам, в отличие от первого шага
+    std::vector<float> steps;
+    for(size_t i = 1; i < result.projections.size(); ++i)
+        steps.push_back(result.projections[i] - result.projections[i - 1]);
+    if(steps.empty())
+        return result;
+    std::vector<float> sorted_steps = steps;
+    std::nth_element(sorted_steps.begin(), sorted_steps.begin() + sorted_steps.size() / 2,
+                     sorted_steps.end());
+    result.spacing = sorted_steps[sorted_steps.size() / 2];
+
+    for(float step: steps)
+        if(step > GAP_FACTOR * result.spacing)
+            result.missing += static_cast<size_t>(std::lround(step / result.spacing)) - 1;
+    return result;
+}
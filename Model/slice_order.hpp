@@ -0,0 +1,40 @@
+#ifndef SLICE_ORDER_HPP
+#define SLICE_ORDER_HPP
+
+#include <array>
+#include <vector>
+#include <opencv2/core.hpp>
+
+
+/// Упорядочивание срезов серии вдоль нормали к ним.
+/// Переставляются не изображения, а номера срезов: порядок применяется
+/// вызывающим при обходе, поэтому пиксели не копируются
+namespace SLICE_ORDER {
+    /// Срезы с проекциями ближе этого расстояния (мм) считаются совпадающими
+    constexpr float DUPLICATE_TOLERANCE = 1e-2f;
+    /// Шаг больше медианного во столько раз считается пропуском срезов
+    constexpr float GAP_FACTOR = 1.5f;
+
+    /// Результат упорядочивания
+    struct Order {
+        std::vector<size_t> order;          /// Номера срезов вдоль нормали (без повторов)
+        std::vector<float>  projections;    /// Проекции положений на нормаль в этом порядке
+        std::vector<size_t> duplicates;     /// Срезы, совпавшие по положению с уже взятым
+        size_t              missing = 0;    /// Оценка количества пропущенных срезов
+        float               spacing = 1.0f; /// Расстояние между срезами (медиана шагов)
+        cv::Vec3f           normal;         /// Нормаль к срезам
+    };
+
+    /// @brief Нормаль к срезам по ImageOrientationPatient
+    cv::Vec3f normal(const std::array<float, 6> &orientation);
+
+    /// @brief Упорядочивает срезы по проекции ImagePositionPatient на нормаль.
+    /// Из совпадающих по положению срезов остается первый по номеру
+    /// @param positions Положения срезов
+    /// @param orientation Ориентация срезов (cos's), общая для серии
+    Order sort(const std::vector<cv::Point3f> &positions,
+               const std::array<float, 6> &orientation);
+}
+
+
+#endif //SLICE_ORDER_HPP
@@ -0,0 +1,306 @@
+#include "study_cache.hpp"
+#include "file_io.hpp"
+#include "ply_io.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+
+
+namespace {
+    /// Версия формата файлов. Менять при изменении структуры записей
+    constexpr uint32_t FORMAT_VERSION = 2;
+
+    enum class Kind: uint32_t {
+        Volume = 1,
+        Cloud = 2,
+        Mesh = 3
+    };
+
+    /// Заголовок бинарного файла кэша. Данные идут сразу за ним
+    struct FileHeader {
+        char     magic[8];
+        uint32_t version;
+        uint32_t kind;
+        uint64_t counts[4];
+        int64_t  extent[6];
+        double   values[8];
+    };
+
+    /// @brief Проверяет заголовок файла кэша и возвращает указатель на него
+    const FileHeader* fileHeader(const FILE_IO::MappedFile &file, Kind kind) {
+        if(!file.data() || file.size() < sizeof(FileHeader))
+            return nullptr;
+        auto *h = reinterpret_cast<const FileHeader*>(file.data());
+        if(std::memcmp(h->magic, "VVCACHE", 8) != 0 ||
+           h->version != FORMAT_VERSION || h->kind != static_cast<uint32_t>(kind))
+            return nullptr;
+        return h;
+    }
+
+    /// @brief Данные после заголовка, если их не меньше bytes
+    const char* payload(const FILE_IO::MappedFile &file, size_t bytes) {
+        if(file.size() < sizeof(FileHeader) + bytes)
+            return nullptr;
+        return file.data() + sizeof(FileHeader);
+    }
+
+    FileHeader makeHeader(Kind kind) {
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "VVCACHE", 8);
+        header.version = FORMAT_VERSION;
+        header.kind = static_cast<uint32_t>(kind);
+        return header;
+    }
+
+    std::string entryPath(const std::string &key, const std::string &name) {
+        return STUDY_CACHE::cacheDirectory() + "/" + key + "/" + name;
+    }
+
+    /// @brief Записывает блоки данных во временный файл и переименовывает его
+    bool writeFile(const std::string &path,
+                   const std::vector<std::pair<const void*, size_t>> &blocks) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+        // Уникальное имя: запись одного ключа может идти из разных задач одновременно
+        std::string tmp_path = path + ".tmp" + std::to_string(::getpid()) + "_" +
+                               std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        bool written = false;
+        {
+            std::ofstream output(tmp_path, std::ios::binary | std::ios::trunc);
+            for(auto &block: blocks)
+                if(output)
+                    output.write(static_cast<const char*>(block.first), block.second);
+            output.close();
+            written = static_cast<bool>(output);
+        }
+        if(written)
+            std::filesystem::rename(tmp_path, path, error);
+        if(!written || error) {
+            std::cerr << "Error: cannot write cache file " << path;
+            if(error)
+                std::cerr << " (" << error.message() << ")";
+            std::cerr << std::endl;
+            // Недописанный временный файл иначе остался бы в кэше навсегда
+            std::filesystem::remove(tmp_path, error);
+            return false;
+        }
+        return true;
+    }
+}
+
+std::string STUDY_CACHE::cacheDirectory() {
+    if(const char *dir = std::getenv("VTK_VIEWER_CACHE_DIR"))
+        return dir;
+    if(const char *xdg = std::getenv("XDG_CACHE_HOME"))
+        return std::string(xdg) + "/vtk_viewer";
+    if(const char *home = std::getenv("HOME"))
+        return std::string(home) + "/.cache/vtk_viewer";
+    return (std::filesystem::temp_directory_path() / "vtk_viewer").string();
+}
+
+std::string STUDY_CACHE::key(const std::string &series_uid,
+                             const std::vector<std::string> &files,
+                             const std::string &parameters) {
+    // Без SeriesInstanceUID разные исследования неразличимы
+    if(series_uid.empty())
+        return std::string();
+
+    /// FNV-1a 64 от серии, состава файлов (имена, размеры, время изменения) и параметров
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const std::string &str) {
+        for(unsigned char c: str) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        hash ^= 0xff;
+        hash *= 1099511628211ull;
+    };
+    mix(series_uid);
+    // Дописанные или удаленные срезы той же серии дают другой ключ.
+    // Порядок файлов в индексе зависит от положений срезов, поэтому сортируется
+    std::vector<std::string> sorted = files;
+    std::sort(sorted.begin(), sorted.end());
+    mix(std::to_string(sorted.size()));
+    for(auto &file: sorted) {
+        mix(file);
+        // Повторная выгрузка исследования в ту же папку под теми же именами
+        // меняет размер или время изменения файлов
+        std::error_code error;
+        const uintmax_t size = std::filesystem::file_size(file, error);
+        mix(error ? std::string() : std::to_string(size));
+        const auto modified = std::filesystem::last_write_time(file, error);
+        mix(error ? std::string() : std::to_string(modified.time_since_epoch().count()));
+    }
+    mix(parameters);
+
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+bool STUDY_CACHE::saveVolume(const std::string &key, vtkImageData *volume) {
+    if(key.empty() || !volume || !volume->GetPointData()->GetScalars())
+        return false;
+    vtkDataArray *scalars = volume->GetPointData()->GetScalars();
+
+    FileHeader header = makeHeader(Kind::Volume);
+    // После reslice экстент не обязательно начинается с нуля, поэтому хранится целиком
+    int *extent = volume->GetExtent();
+    for(int i = 0; i != 6; ++i)
+        header.extent[i] = extent[i];
+    header.counts[0] = static_cast<uint64_t>(scalars->GetDataType());
+    header.counts[1] = static_cast<uint64_t>(scalars->GetNumberOfComponents());
+    volume->GetSpacing(&header.values[0]);
+    volume->GetOrigin(&header.values[3]);
+
+    size_t bytes = static_cast<size_t>(scalars->GetNumberOfTuples()) *
+                   scalars->GetNumberOfComponents() * scalars->GetDataTypeSize();
+    return writeFile(entryPath(key, "volume.bin"), {{&header, sizeof(header)}, {scalars->GetVoidPointer(0), bytes}});
+}
+
+vtkSmartPointer<vtkImageData> STUDY_CACHE::loadVolume(const std::string &key) {
+    if(key.empty())
+        return nullptr;
+    FILE_IO::MappedFile file(entryPath(key, "volume.bin"));
+    const FileHeader *header = fileHeader(file, Kind::Volume);
+    if(!header)
+        return nullptr;
+
+    int type = static_cast<int>(header->counts[0]);
+    int components = static_cast<int>(header->counts[1]);
+    int extent[6];
+    for(int i = 0; i != 6; ++i)
+        extent[i] = static_cast<int>(header->extent[i]);
+    auto volume = vtkSmartPointer<vtkImageData>::New();
+    volume->SetExtent(extent);
+    volume->SetSpacing(&header->values[0]);
+    volume->SetOrigin(&header->values[3]);
+    volume->AllocateScalars(type, components);
+
+    vtkDataArray *scalars = volume->GetPointData()->GetScalars();
+    size_t bytes = static_cast<size_t>(scalars->GetNumberOfTuples()) *
+                   components * scalars->GetDataTypeSize();
+    const char *payload = payload(file, bytes);
+    if(!payload)
+        return nullptr;
+    std::memcpy(scalars->GetVoidPointer(0), payload, bytes);
+    return volume;
+}
+
+bool STUDY_CACHE::saveCloud(const std::string &key, const std::vector<cv::Point3f> &cloud) {
+    if(key.empty())
+        return false;
+    FileHeader header = makeHeader(Kind::Cloud);
+    header.counts[0] = cloud.size();
+    return writeFile(entryPath(key, "cloud.bin"),
+                     {{&header, sizeof(header)}, {cloud.data(), cloud.size() * sizeof(cv::Point3f)}});
+}
+
+bool STUDY_CACHE::loadCloud(const std::string &key, std::vector<cv::Point3f> &cloud) {
+    if(key.empty())
+        return false;
+    FILE_IO::MappedFile file(entryPath(key, "cloud.bin"));
+    const FileHeader *header = fileHeader(file, Kind::Cloud);
+    if(!header)
+        return false;
+    size_t count = header->counts[0];
+    auto *points = reinterpret_cast<const cv::Point3f*>(payload(file, count * sizeof(cv::Point3f)));
+    if(!points)
+        return false;
+    cloud.assign(points, points + count);
+    return true;
+}
+
+bool STUDY_CACHE::saveMesh(const std::string &key, vtkPolyData *mesh) {
+    if(key.empty() || !mesh)
+        return false;
+
+    /// Точки в float32 (x, y, z) и полигоны [n, id_0 .. id_n-1] в int32 подряд:
+    /// после заливки дыр в модели бывают не только треугольники.
+    /// Массивы берутся из vtkPolyData целиком (PLY_IO), без обхода по ячейкам
+    const PLY_IO::Mesh flat = PLY_IO::fromPolyData(mesh);
+    FileHeader header = makeHeader(Kind::Mesh);
+    header.counts[0] = flat.numberOfPoints();
+    header.counts[1] = flat.faces;
+    header.counts[2] = flat.polygons.size();
+    return writeFile(entryPath(key, "mesh.bin"),
+                     {{&header, sizeof(header)},
+                      {flat.points.data(), flat.points.size() * sizeof(float)},
+                      {flat.polygons.data(), flat.polygons.size() * sizeof(int32_t)}});
+}
+
+vtkSmartPointer<vtkPolyData> STUDY_CACHE::loadMesh(const std::string &key) {
+    if(key.empty())
+        return nullptr;
+    FILE_IO::MappedFile file(entryPath(key, "mesh.bin"));
+    const FileHeader *header = fileHeader(file, Kind::Mesh);
+    if(!header)
+        return nullptr;
+
+    const size_t num_points = header->counts[0];
+    const size_t num_faces = header->counts[1];
+    const size_t num_ids = header->counts[2];
+    const size_t points_bytes = num_points * 3 * sizeof(float);
+    const char *data = payload(file, points_bytes + num_ids * sizeof(int32_t));
+    if(!data)
+        return nullptr;
+
+    PLY_IO::Mesh flat;
+    auto *coords = reinterpret_cast<const float*>(data);
+    auto *polygons = reinterpret_cast<const int32_t*>(data + points_bytes);
+    flat.points.assign(coords, coords + num_points * 3);
+    flat.polygons.assign(polygons, polygons + num_ids);
+    flat.faces = num_faces;
+
+    // Поврежденная запись не должна дойти до отрисовки индексами за пределами точек
+    size_t pos = 0, face = 0;
+    for(; face != num_faces && pos < num_ids; ++face) {
+        const int32_t n = flat.polygons[pos++];
+        if(n < 0 || pos + static_cast<size_t>(n) > num_ids)
+            return nullptr;
+        for(const size_t end = pos + static_cast<size_t>(n); pos != end; ++pos)
+            if(flat.polygons[pos] < 0 || static_cast<size_t>(flat.polygons[pos]) >= num_points)
+                return nullptr;
+    }
+    if(face != num_faces || pos != num_ids)
+        return nullptr;
+    return PLY_IO::toPolyData(flat);
+}
+
+bool STUDY_CACHE::saveMeta(const std::string &key, const std::map<std::string, std::string> &meta) {
+    if(key.empty())
+        return false;
+    std::map<std::string, std::string> merged = loadMeta(key);
+    for(auto &item: meta)
+        merged[item.first] = item.second;
+
+    // Как и бинарные записи, через временный файл: параллельная запись
+    // или прерванный процесс не оставляют обрезанное описание
+    std::string text;
+    for(auto &item: merged)
+        text += item.first + "=" + item.second + "\n";
+    return writeFile(entryPath(key, "meta.txt"), {{text.data(), text.size()}});
+}
+
+std::map<std::string, std::string> STUDY_CACHE::loadMeta(const std::string &key) {
+    std::map<std::string, std::string> meta;
+    if(key.empty())
+        return meta;
+    std::ifstream input(entryPath(key, "meta.txt"));
+    std::string line;
+    while(std::getline(input, line)) {
+        size_t sep = line.find('=');
+        if(sep != std::string::npos)
+            meta[line.substr(0, sep)] = line.substr(sep + 1);
+    }
+    return meta;
+}
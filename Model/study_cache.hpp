@@ -0,0 +1,53 @@
+#ifndef STUDY_CACHE_HPP
+#define STUDY_CACHE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+#include <vtkPolyData.h>
+
+
+/// Локальный кэш результатов обработки исследования.
+/// Для каждой пары (серия, параметры конвейера) создается директория
+/// <cacheDirectory()>/<key>/ с бинарными файлами, пригодными для отображения
+/// в память (mmap): volume.bin - ориентированный объем, cloud.bin - облако точек
+/// поверхности головы, mesh.bin - итоговая модель, meta.txt - описание.
+/// Файлы записываются во временный файл и переименовываются, поэтому
+/// прерванная запись не оставляет битых данных. Пустой ключ означает,
+/// что кэш отключен: запись ничего не делает, чтение ничего не находит
+namespace STUDY_CACHE {
+    /// @brief Корневая директория кэша: $VTK_VIEWER_CACHE_DIR,
+    /// иначе $XDG_CACHE_HOME/vtk_viewer, иначе ~/.cache/vtk_viewer
+    std::string cacheDirectory();
+
+    /// @brief Ключ кэша. Пустой, если серия не указана
+    /// @param series_uid SeriesInstanceUID исследования
+    /// @param files Файлы серии (порядок не важен). В ключ входят их имена,
+    /// размеры и время изменения
+    /// @param parameters Описание параметров конвейера, влияющих на результат
+    std::string key(const std::string &series_uid,
+                    const std::vector<std::string> &files,
+                    const std::string &parameters);
+
+    /// @brief Сохраняет/загружает ориентированный объем для просмотрщиков
+    bool saveVolume(const std::string &key, vtkImageData *volume);
+    vtkSmartPointer<vtkImageData> loadVolume(const std::string &key);
+
+    /// @brief Сохраняет/загружает облако точек поверхности головы
+    bool saveCloud(const std::string &key, const std::vector<cv::Point3f> &cloud);
+    bool loadCloud(const std::string &key, std::vector<cv::Point3f> &cloud);
+
+    /// @brief Сохраняет/загружает итоговую модель головы
+    bool saveMesh(const std::string &key, vtkPolyData *mesh);
+    vtkSmartPointer<vtkPolyData> loadMesh(const std::string &key);
+
+    /// @brief Дописывает/читает описание записи кэша (пары ключ-значение)
+    bool saveMeta(const std::string &key, const std::map<std::string, std::string> &meta);
+    std::map<std::string, std::string> loadMeta(const std::string &key);
+}
+
+
+#endif //STUDY_CACHE_HPP
@@ -0,0 +1,204 @@
+#include "study_volume.hpp"
+#include "trace.hpp"
+#include <vtkPointData.h>
+#include <vtkImageReslice.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMath.h>
+#include <vtkTransform.h>
+#include <opencv2/imgproc.hpp>
+
+
+namespace {
+    /// @brief Декодирует часть срезов индекса в их ячейки общего объема
+    /// и раскладывает результаты в series по исходным номерам
+    void loadPart(const DICOM_LOADER::StudyIndex &index,
+                  const std::vector<size_t> &part,
+                  std::vector<cv::Mat> &targets,
+                  DICOM_LOADER::Series &series,
+                  const std::string &stage) {
+        DICOM_LOADER::StudyIndex part_index;
+        part_index.series_uid = index.series_uid;
+        part_index.slice_spacing = index.slice_spacing;
+        std::vector<cv::Mat> part_targets;
+        for(size_t k: part) {
+            part_index.files.push_back(index.files[k]);
+            part_targets.push_back(targets[k]);
+        }
+
+        DICOM_LOADER::Series loaded = DICOM_LOADER::load(part_index, part_targets,
+                                                         PARALLEL::threads(), stage);
+        for(size_t i = 0; i != part.size(); ++i)
+            series.slices[part[i]] = std::move(loaded.slices[i]);
+        series.total_ms += loaded.total_ms;
+        series.threads = loaded.threads;
+    }
+}
+
+std::shared_ptr<const STUDY_VOLUME::Volume> STUDY_VOLUME::read(const std::string &directory) {
+    // Индекс по заголовкам: декодируются только файлы выбранной серии, уже в порядке срезов
+    return read(DICOM_LOADER::index(directory));
+}
+
+std::shared_ptr<const STUDY_VOLUME::Volume> STUDY_VOLUME::read(const DICOM_LOADER::StudyIndex &index,
+                                                               const PreviewCallback &preview) {
+    if(index.files.empty())
+        return nullptr;
+
+    auto volume = std::make_shared<Volume>();
+    const DICOM_LOADER::Header &first = index.files[0];
+    int rows = first.rows;
+    int cols = first.cols;
+    int depth = static_cast<int>(index.files.size());
+
+    /// Параметры исследования известны из заголовков еще до декодирования,
+    /// поэтому предпросмотр можно показывать в правильной системе координат
+    volume->spaces = first.spaces;
+    volume->orientation = first.orientation;
+    volume->research_type = first.research_type;
+    volume->pixel_signed = first.pixel_signed;
+    volume->rescale_slope = first.rescale.first;
+    volume->rescale_intercept = first.rescale.second;
+    volume->slice_spacing = index.slice_spacing;
+    volume->series_uid = index.series_uid;
+    for(auto &file: index.files)
+        volume->positions.emplace_back(file.position);
+
+    /// Единственная копия пикселей исследования: размеры известны из заголовков,
+    /// поэтому объем выделяется заранее и срезы декодируются прямо в него
+    volume->image = vtkSmartPointer<vtkImageData>::New();
+    volume->image->SetDimensions(cols, rows, depth);
+    volume->image->SetOrigin(0, 0, 0);
+    volume->image->SetSpacing(volume->spaces.first, volume->spaces.second, volume->slice_spacing);
+    volume->image->AllocateScalars(first.pixel_signed ? VTK_SHORT : VTK_UNSIGNED_SHORT, 1);
+
+    auto *buffer = static_cast<uint16_t*>(volume->image->GetScalarPointer());
+    size_t slice_size = static_cast<size_t>(rows) * cols;
+    for(int k = 0; k != depth; ++k)
+        volume->slices.emplace_back(rows, cols, CV_16UC1, buffer + k * slice_size);
+
+    const int coarse_factor = PYRAMID_FACTORS.back();
+    vtkSmartPointer<vtkImageData> coarse_level;
+    DICOM_LOADER::Series series;
+    if(preview && depth >= 2 * coarse_factor) {
+        // Сначала декодируется каждый coarse_factor-й срез: их достаточно для грубого уровня,
+        // остальные срезы догружаются, пока пользователь уже видит исследование
+        std::vector<size_t> coarse, rest;
+        for(int k = 0; k != depth; ++k)
+            (k % coarse_factor ? rest : coarse).push_back(k);
+        series.slices.resize(depth);
+        loadPart(index, coarse, volume->slices, series, "preview");
+        coarse_level = downsample(*volume, coarse_factor);
+        preview(*volume, coarse_level);
+        JOB::checkpoint();
+        loadPart(index, rest, volume->slices, series, "decode");
+    } else {
+        series = DICOM_LOADER::load(index, volume->slices);
+    }
+    DICOM_LOADER::printReport(series);
+    volume->image->GetPointData()->GetScalars()->Modified();
+
+    for(int factor: PYRAMID_FACTORS) {
+        if(factor == coarse_factor && coarse_level)
+            volume->pyramid.push_back(coarse_level);
+        else
+            volume->pyramid.push_back(downsample(*volume, factor));
+    }
+    return volume;
+}
+
+vtkSmartPointer<vtkImageData> STUDY_VOLUME::downsample(const Volume &volume, int factor) {
+    if(volume.slices.empty() || factor < 1)
+        return nullptr;
+    TRACE_SCOPE("downsample");
+
+    int rows = volume.slices[0].rows;
+    int cols = volume.slices[0].cols;
+    int depth = static_cast<int>(volume.slices.size());
+    int level_rows = std::max(1, rows / factor);
+    int level_cols = std::max(1, cols / factor);
+    int level_depth = (depth + factor - 1) / factor;
+
+    // Размер пикселя уровня подбирается так, чтобы срез покрывал ту же область,
+    // а центр усредненного пикселя совпадал с центром блока исходных
+    double spacing_x = volume.spaces.first * cols / level_cols;
+    double spacing_y = volume.spaces.second * rows / level_rows;
+    auto level = vtkSmartPointer<vtkImageData>::New();
+    level->SetDimensions(level_cols, level_rows, level_depth);
+    level->SetOrigin((spacing_x - volume.spaces.first) / 2, (spacing_y - volume.spaces.second) / 2, 0);
+    level->SetSpacing(spacing_x, spacing_y, volume.slice_spacing * factor);
+    level->AllocateScalars(volume.pixel_signed ? VTK_SHORT : VTK_UNSIGNED_SHORT, 1);
+
+    // Знаковые пиксели должны усредняться как знаковые
+    int type = volume.pixel_signed ? CV_16SC1 : CV_16UC1;
+    auto *buffer = static_cast<uint16_t*>(level->GetScalarPointer());
+    size_t level_size = static_cast<size_t>(level_rows) * level_cols;
+    PARALLEL::parallel_for(level_depth, [&](size_t k) {
+        const cv::Mat &slice = volume.slices[k * factor];
+        cv::Mat src(rows, cols, type, slice.data, slice.step);
+        cv::Mat dst(level_rows, level_cols, type, buffer + k * level_size);
+        cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+    });
+    return level;
+}
+
+vtkSmartPointer<vtkImageData> STUDY_VOLUME::orient(const Volume &volume, vtkImageData *image) {
+    if(!image)
+        image = volume.image;
+
+    // Ищем граничные координаты
+    double bounds[6];
+    image->GetBounds(bounds);
+
+    // Поворот набора точек - подготовка к последующей трансформации.
+    // Строки в объеме уже идут сверху вниз, как в DICOM (vtkDICOMImageReader
+    // переворачивал их, а этот reslice возвращал обратно), поэтому отражается только z
+    vtkNew<vtkImageReslice> flip;
+    flip->SetInputData(image);
+    flip->SetResliceAxesOrigin(0, 0, (bounds[5] - bounds[4]));
+    flip->SetResliceAxesDirectionCosines(1,0,0, 0,1,0, 0,0,-1);
+    {
+        TRACE_SCOPE("reslice flip");
+        flip->Update();
+    }
+
+    vtkNew<vtkMatrix4x4> matrix;
+    // Составляем матрицу для перевода точек из системы координат vtk в dicom'овские
+    const cv::Point3f &origin = volume.positions[0];
+    const float position[3] = {origin.x, origin.y, origin.z};
+    const float *xdir = &volume.orientation[0];
+    const float *ydir = &volume.orientation[3];
+    float zdir[3];
+    vtkMath::Cross(xdir, ydir, zdir);
+    for(int i = 0; i != 3; ++i) {
+        matrix->Element[i][0] = xdir[i];
+        matrix->Element[i][1] = ydir[i];
+        matrix->Element[i][2] = zdir[i];
+        matrix->Element[i][3] = position[i];
+    }
+    matrix->Element[3][0] = 0;
+    matrix->Element[3][1] = 0;
+    matrix->Element[3][2] = 0;
+    matrix->Element[3][3] = 1;
+    matrix->Modified();
+    matrix->Invert();
+
+    // Длеаем трансофрмацию с матрицей
+    vtkNew<vtkTransform> tr;
+    tr->SetMatrix(matrix);
+    tr->Update();
+
+    // monke flip
+    vtkNew<vtkImageReslice> monke;
+    monke->SetInputData(flip->GetOutput());
+    monke->SetResliceTransform(tr);
+    monke->SetInterpolationModeToLinear();
+    monke->AutoCropOutputOn();
+    {
+        TRACE_SCOPE("reslice orient");
+        monke->Update();
+    }
+
+    // Результат reslice принадлежит только нам, копировать его не нужно
+    vtkSmartPointer<vtkImageData> oriented = monke->GetOutput();
+    return oriented;
+}
@@ -0,0 +1,69 @@
+#ifndef STUDY_VOLUME_HPP
+#define STUDY_VOLUME_HPP
+
+#include "dicom_loader.hpp"
+#include <memory>
+#include <functional>
+#include <vtkSmartPointer.h>
+#include <vtkImageData.h>
+
+
+namespace STUDY_VOLUME {
+    /// @brief Декодированное и отсортированное исследование.
+    /// Пиксели хранятся один раз в скалярах vtkImageData (срез за срезом,
+    /// строки в порядке DICOM - сверху вниз), а slices - это заголовки cv::Mat,
+    /// ссылающиеся на ту же память. Поэтому объем передается между построением
+    /// модели и просмотрщиками без копирования и должен жить, пока живут slices
+    struct Volume {
+        vtkSmartPointer<vtkImageData> image;        /// Объем для vtk (cols x rows x slices)
+        std::vector<cv::Mat>          slices;       /// Срезы для openCV (16 бит, без владения)
+        std::vector<cv::Point3f>      positions;    /// Положения срезов в пространстве
+        std::pair<float, float>       spaces;       /// Расстояния между пикселями
+        float                         slice_spacing = 1.0f; /// Расстояние между срезами
+        std::array<float, 6>          orientation;  /// Ориентация срезов (cos's)
+        std::string                   research_type;/// Тип исследования (MR/CT)
+        std::string                   series_uid;   /// SeriesInstanceUID
+        bool                          pixel_signed = false; /// Знаковые ли пиксели
+        float                         rescale_slope = 1.0f;     /// Перевод в единицы модальности:
+        float                         rescale_intercept = 0.0f; /// value * slope + intercept
+        /// Пирамида уменьшенных копий объема для быстрого предпросмотра:
+        /// pyramid[i] уменьшен в PYRAMID_FACTORS[i] раз по всем осям (владеет своими пикселями)
+        std::vector<vtkSmartPointer<vtkImageData>> pyramid;
+    };
+
+    /// Во сколько раз уменьшены уровни пирамиды
+    const std::array<int, 2> PYRAMID_FACTORS = {2, 4};
+
+    /// @brief Получает грубый уровень объема до окончания загрузки.
+    /// volume - собираемый объем (параметры уже заданы, пиксели загружены не все),
+    /// level - уменьшенная копия, оба живут только на время вызова
+    using PreviewCallback = std::function<void(const Volume &volume, vtkImageData *level)>;
+
+    /// @brief Читает директорию с исследованием: индексирует файлы по заголовкам,
+    /// параллельно декодирует срезы выбранной серии и собирает единый объем
+    /// @param directory Путь к директории с исследованием
+    /// @return Объем исследования, либо nullptr, если файлов не найдено
+    std::shared_ptr<const Volume> read(const std::string &directory);
+
+    /// @brief Собирает объем по готовому индексу исследования.
+    /// Если задан preview, сначала декодируется каждый PYRAMID_FACTORS.back()-й срез,
+    /// и по ним строится грубый уровень для предпросмотра, затем остальные срезы
+    /// @param index Индекс исследования
+    /// @param preview Обработчик грубого уровня (вызывается в потоке загрузки)
+    std::shared_ptr<const Volume> read(const DICOM_LOADER::StudyIndex &index,
+                                       const PreviewCallback &preview = nullptr);
+
+    /// @brief Строит уменьшенную копию объема: в плоскости среза - усреднением
+    /// (cv::INTER_AREA), по срезам - прореживанием
+    /// @param volume Объем (используются срезы 0, factor, 2 * factor, ...)
+    /// @param factor Во сколько раз уменьшить
+    vtkSmartPointer<vtkImageData> downsample(const Volume &volume, int factor);
+
+    /// @brief Переводит объем исследования в систему координат пациента
+    /// @param volume Объем (используются положение первого среза и ориентация)
+    /// @param image Уровень пирамиды объема, по умолчанию полное разрешение
+    vtkSmartPointer<vtkImageData> orient(const Volume &volume, vtkImageData *image = nullptr);
+}
+
+
+#endif //STUDY_VOLUME_HPP
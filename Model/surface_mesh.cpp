@@ -0,0 +1,63 @@
+#include "surface_mesh.hpp"
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkFloatArray.h>
+#include <vtkCellArray.h>
+#include <vtkVersionMacros.h>
+#if VTK_MAJOR_VERSION >= 9
+#include <vtkTypeInt32Array.h>
+#else
+#include <vtkIdTypeArray.h>
+#endif
+
+
+vtkSmartPointer<vtkPolyData> SURFACE_MESH::toPolyData(Mesh &&mesh) {
+    const vtkIdType num_points = static_cast<vtkIdType>(mesh.numberOfPoints());
+    const vtkIdType num_triangles = static_cast<vtkIdType>(mesh.numberOfTriangles());
+
+    /// Вершины переходят в vtkFloatArray вместе с памятью, VTK освободит ее через free
+    vtkNew<vtkFloatArray> coords;
+    coords->SetNumberOfComponents(3);
+    if(num_points)
+        coords->SetArray(mesh.points.release(), num_points * 3, 0, vtkAbstractArray::VTK_DATA_ARRAY_FREE);
+    mesh.points.reset();
+    vtkNew<vtkPoints> points;
+    points->SetData(coords);
+
+    vtkNew<vtkCellArray> triangles;
+#if VTK_MAJOR_VERSION >= 9
+    /// Связность хранится в 32-битном виде: индексы переходят как есть,
+    /// создается только массив смещений 0, 3, 6, ...
+    vtkNew<vtkTypeInt32Array> offsets;
+    offsets->SetNumberOfValues(num_triangles + 1);
+    int32_t *offset = offsets->GetPointer(0);
+    for(vtkIdType i = 0; i <= num_triangles; ++i)
+        offset[i] = static_cast<int32_t>(3 * i);
+    vtkNew<vtkTypeInt32Array> connectivity;
+    if(num_triangles)
+        connectivity->SetArray(mesh.triangles.release(), num_triangles * 3, 0,
+                               vtkAbstractArray::VTK_DATA_ARRAY_FREE);
+    mesh.triangles.reset();
+    triangles->SetData(offsets, connectivity);
+#else
+    /// Связность в виде [3, a, b, c] подряд передается в vtkCellArray одним массивом,
+    /// индексы модели освобождаются сразу после переноса
+    vtkNew<vtkIdTypeArray> connectivity;
+    connectivity->SetNumberOfValues(num_triangles * 4);
+    vtkIdType *ids = connectivity->GetPointer(0);
+    const int32_t *source = mesh.triangles.data();
+    for(vtkIdType i = 0; i != num_triangles; ++i, source += 3) {
+        *ids++ = 3;
+        *ids++ = source[0];
+        *ids++ = source[1];
+        *ids++ = source[2];
+    }
+    mesh.triangles.reset();
+    triangles->SetCells(num_triangles, connectivity);
+#endif
+
+    auto data = vtkSmartPointer<vtkPolyData>::New();
+    data->SetPoints(points);
+    data->SetPolys(triangles);
+    return data;
+}
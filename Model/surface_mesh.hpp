@@ -0,0 +1,91 @@
+#ifndef SURFACE_MESH_HPP
+#define SURFACE_MESH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+
+/// Компактное представление результата реконструкции: плоские массивы вершин
+/// и индексов треугольников. Тип только перемещается - копия модели не может
+/// появиться случайно. Перевод в VTK забирает массивы вместе с памятью
+namespace SURFACE_MESH {
+    /// Массив в памяти malloc. Память можно отдать массиву VTK без копирования
+    /// (SetArray с VTK_DATA_ARRAY_FREE), после этого буфер пуст
+    template<typename T>
+    class Buffer {
+        static_assert(std::is_trivially_copyable<T>::value, "Buffer stores plain values only");
+
+    public:
+        Buffer() = default;
+        explicit Buffer(size_t size): values(static_cast<T*>(std::malloc(size * sizeof(T)))), count(size) {
+            if(size && !values)
+                throw std::bad_alloc();
+        }
+        Buffer(Buffer &&other) noexcept: values(other.values), count(other.count) {
+            other.values = nullptr;
+            other.count = 0;
+        }
+        Buffer &operator=(Buffer &&other) noexcept {
+            if(this != &other) {
+                reset();
+                std::swap(values, other.values);
+                std::swap(count, other.count);
+            }
+            return *this;
+        }
+        ~Buffer() { std::free(values); }
+
+        T *data() { return values; }
+        const T *data() const { return values; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        /// @brief Отдает память вызывающему, он освобождает ее через free
+        T *release() {
+            T *result = values;
+            values = nullptr;
+            count = 0;
+            return result;
+        }
+
+        /// @brief Освобождает память
+        void reset() {
+            std::free(values);
+            values = nullptr;
+            count = 0;
+        }
+
+    private:
+        T *values = nullptr;
+        size_t count = 0;
+    };
+
+    struct Mesh {
+        Buffer<float> points;           /// x, y, z подряд
+        Buffer<int32_t> triangles;      /// a, b, c подряд
+
+        Mesh() = default;
+        Mesh(Mesh &&) = default;
+        Mesh &operator=(Mesh &&) = default;
+        Mesh(const Mesh &) = delete;
+        Mesh &operator=(const Mesh &) = delete;
+
+        size_t numberOfPoints() const { return points.size() / 3; }
+        size_t numberOfTriangles() const { return triangles.size() / 3; }
+    };
+
+    /// @brief Перевод в vtkPolyData. Вершины (и индексы на VTK 9) передаются
+    /// массивам VTK без копирования, остальное освобождается сразу после перевода,
+    /// поэтому две копии модели одновременно в памяти не живут
+    /// @param mesh Модель, после вызова пуста
+    vtkSmartPointer<vtkPolyData> toPolyData(Mesh &&mesh);
+}
+
+
+#endif //SURFACE_MESH_HPP
@@ -0,0 +1,139 @@
+#include "trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /// Событие: начало и длительность в наносекундах
+    struct Event {
+        const char *name;
+        int64_t start;
+        int64_t duration;
+    };
+
+    /// Буфер одного потока. Мьютекс захватывается только самим потоком
+    /// и при записи файла, поэтому почти всегда свободен
+    struct Buffer {
+        uint32_t tid = 0;
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Buffer>> buffers;   /// Переживают свои потоки
+        uint32_t next_tid = 1;
+    };
+
+    const Clock::time_point origin = Clock::now();
+
+    Registry &registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    /// Путь к файлу трассировки (пустой - трассировка выключена)
+    const std::string &tracePath() {
+        static const std::string path = [] {
+            const char *value = std::getenv("VTK_VIEWER_TRACE");
+            return std::string(value ? value : "");
+        }();
+        return path;
+    }
+
+    /// Запись файла при завершении программы. Реестр создается до регистрации
+    /// обработчика, чтобы быть разрушенным после него
+    struct FlushAtExit {
+        FlushAtExit() {
+            if(tracePath().empty())
+                return;
+            registry();
+            std::atexit([] { TRACE::flush(); });
+        }
+    };
+
+    Buffer &threadBuffer() {
+        thread_local std::shared_ptr<Buffer> buffer = [] {
+            auto created = std::make_shared<Buffer>();
+            created->events.reserve(1024);
+            Registry &reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            created->tid = reg.next_tid++;
+            reg.buffers.push_back(created);
+            return created;
+        }();
+        return *buffer;
+    }
+
+    /// Название этапа в строке JSON
+    void writeEscaped(FILE *file, const char *text) {
+        for(; *text; ++text) {
+            if(*text == '"' || *text == '\\')
+                std::fputc('\\', file);
+            if(static_cast<unsigned char>(*text) >= 0x20)
+                std::fputc(*text, file);
+        }
+    }
+}
+
+bool TRACE::enabled() {
+    static const bool on = [] {
+        static FlushAtExit flush_at_exit;
+        return !tracePath().empty();
+    }();
+    return on;
+}
+
+int64_t TRACE::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+}
+
+void TRACE::record(const char *name, int64_t start, int64_t duration) {
+    Buffer &buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back({name, start, duration});
+}
+
+bool TRACE::flush() {
+    if(!enabled())
+        return false;
+    FILE *file = std::fopen(tracePath().c_str(), "w");
+    if(!file) {
+        std::cerr << "Error: cannot write trace " << tracePath() << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        buffers = reg.buffers;
+    }
+
+    // Время в формате Trace Event - микросекунды, дробная часть сохраняет наносекунды
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    bool first = true;
+    for(const auto &buffer: buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        for(const Event &event: buffer->events) {
+            std::fputs(first ? "{\"name\":\"" : ",\n{\"name\":\"", file);
+            writeEscaped(file, event.name);
+            std::fprintf(file, "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                               "\"ts\":%lld.%03lld,\"dur\":%lld.%03lld}",
+                         buffer->tid,
+                         static_cast<long long>(event.start / 1000), static_cast<long long>(event.start % 1000),
+                         static_cast<long long>(event.duration / 1000), static_cast<long long>(event.duration % 1000));
+            first = false;
+        }
+    }
+    std::fputs("\n]}\n", file);
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,54 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+
+
+/// Трассировка этапов конвейера в формате Chrome Trace Event (chrome://tracing, Perfetto).
+/// Включается переменной окружения $VTK_VIEWER_TRACE=<путь к файлу .json>: события
+/// копятся в буферах потоков и записываются в файл при завершении программы (или flush()).
+/// Без переменной Scope сводится к проверке одного флага: время не запрашивается,
+/// память не выделяется
+namespace TRACE {
+    /// @brief Включена ли трассировка (переменная окружения читается один раз)
+    bool enabled();
+
+    /// @brief Время с запуска программы, нс (steady_clock)
+    int64_t now();
+
+    /// @brief Добавляет завершенное событие в буфер текущего потока
+    /// @param name Название этапа (строковый литерал: хранится только указатель)
+    /// @param start Начало, нс (now())
+    /// @param duration Длительность, нс
+    void record(const char *name, int64_t start, int64_t duration);
+
+    /// @brief Записывает накопленные события всех потоков в файл $VTK_VIEWER_TRACE
+    /// @return false, если трассировка выключена или файл не записан
+    bool flush();
+
+    /// Замер этапа от создания до конца области видимости
+    class Scope {
+    public:
+        explicit Scope(const char *name): name(enabled() ? name : nullptr) {
+            if(this->name)
+                start = now();
+        }
+        ~Scope() {
+            if(name)
+                record(name, start, now() - start);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        const char *name;
+        int64_t start = 0;
+    };
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+/// Замер этапа до конца текущего блока
+#define TRACE_SCOPE(name) TRACE::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+
+#endif //TRACE_HPP
@@ -1,155 +1,177 @@
 #include "utility_dcm.hpp"
+#include "dicom_codecs.hpp"
+#include <cstring>
+#include <vector>
 
 
 DICOM::DICOM(const std::string& path) {
+    registerCodecs();
     dataset = extractDataset(path);
 }
 
-DcmDataset DICOM::extractDataset(const std::string& path) {
-    DcmFileFormat file;
+DICOM::DICOM(const std::string& path, bool header_only) {
+    registerCodecs();
+    dataset = extractDataset(path, header_only);
+}
 
-    ///Подключение кодеков для декодирования
-    DJDecoderRegistration::registerCodecs();
+void DICOM::registerCodecs() {
+    DICOM_CODECS::ensureRegistered();
+}
 
-    ///Проверка корректности пути к файлу
-    OFCondition status = file.loadFile(path.c_str());
+DcmDataset* DICOM::extractDataset(const std::string& path, bool header_only) {
+    ///Проверка корректности пути к файлу.
+    ///Для заголовка чтение останавливается перед данными пикселей
+    OFCondition status = header_only
+        ? file.loadFileUntilTag(path.c_str(), EXS_Unknown, EGL_noChange,
+                                DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData)
+        : file.loadFile(path.c_str());
     if (status.bad()) {
         std::cerr << "Error: cannot read DICOM file (" << status.text() << ")" << std::endl;
-        return dataset;
+        return file.getDataset();
     }
 
-    ///Извлечение датасета и приведение его к необходимому типу
-    dataset = *file.getDataset();
-    dataset.chooseRepresentation(EXS_LittleEndianExplicit, nullptr);
-
-    ///Кодеки больше не нужны (вроде)
-    DJDecoderRegistration::cleanup();
-    return dataset;
+    ///Датасет не копируется, а используется прямо из файла.
+    ///Сжатые данные пикселей не распаковываются здесь: extractImage(dst)
+    ///декодирует кадр сразу в буфер вызывающего, а extractImageView - по требованию
+    return file.getDataset();
 }
 
-cv::Mat DICOM::extractImage() {
-    ///Инициализация пустой матрицы
-    cv::Mat OpenCVMatrix(0,0, CV_8UC1);
+cv::Mat DICOM::extractImageView() {
+    ///Распаковка сжатого датасета (для несжатого ничего не делает)
+    if(dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr).bad()) {
+        std::cerr << "Error: cannot decompress pixel data" << std::endl;
+        return cv::Mat();
+    }
 
     ///Поиск размеров матрицы
-    uint16_t rows, cols;
-    dataset.findAndGetUint16(DCM_Rows, rows);
-    dataset.findAndGetUint16(DCM_Columns, cols);
+    uint16_t rows = 0, cols = 0;
+    dataset->findAndGetUint16(DCM_Rows, rows);
+    dataset->findAndGetUint16(DCM_Columns, cols);
 
-    ///Матрица значений пикселей из датасета
-    const uint16_t *pixelDataset = new uint16_t[rows * cols];
-    if(dataset.findAndGetUint16Array(DCM_PixelData, pixelDataset).bad()) {
+    ///Указатель на значения пикселей внутри датасета (память принадлежит датасету)
+    const Uint16 *pixelDataset = nullptr;
+    if(dataset->findAndGetUint16Array(DCM_PixelData, pixelDataset).bad()) {
         std::cerr << "Error: cannot access Patient's Info!" << std::endl;
-        return OpenCVMatrix;
+        return cv::Mat();
     }
 
-    if(pixelDataset == nullptr) {
+    if(pixelDataset == nullptr || rows == 0 || cols == 0) {
         std::cerr << "Error: empty pixelData" << std::endl;
-        return OpenCVMatrix;
+        return cv::Mat();
     }
 
-    ///Добавление данных изображения в начальную матрицу
-    OpenCVMatrix = cv::Mat(rows, cols, CV_16UC1);
-    for(int i = 0; i != rows; i++)
-        for(int j = 0; j != cols; j++)
-            OpenCVMatrix.at<uint16_t>(i, j) = pixelDataset[i * cols + j];
-
-    //delete[] pixelDataset;
-    return OpenCVMatrix;
+    return cv::Mat(rows, cols, CV_16UC1, const_cast<Uint16*>(pixelDataset));
 }
 
-cv::Mat DICOM::extractImage(std::pair<float, float> compressScale) {
-    ///Инициализация пустой матрицы
-    cv::Mat OpenCVMatrix(0,0, CV_8UC1);
-
-    ///Поиск размеров матрицы
-    uint16_t rows, cols;
-    dataset.findAndGetUint16(DCM_Rows, rows);
-    dataset.findAndGetUint16(DCM_Columns, cols);
+bool DICOM::extractImage(cv::Mat &dst) {
+    uint16_t rows = 0, cols = 0, bits = 0;
+    dataset->findAndGetUint16(DCM_Rows, rows);
+    dataset->findAndGetUint16(DCM_Columns, cols);
+    dataset->findAndGetUint16(DCM_BitsAllocated, bits);
+    if(rows == 0 || cols == 0 || bits != 16) {
+        std::cerr << "Error: unsupported image (" << rows << "x" << cols << ", "
+                  << bits << " bits)" << std::endl;
+        return false;
+    }
 
-    ///Матрица значений пикселей из датасета
-    const uint16_t *pixelDataset = new uint16_t[rows * cols];
-    if(dataset.findAndGetUint16Array(DCM_PixelData, pixelDataset).bad()) {
-        std::cerr << "Error: cannot access Patient's Info!" << std::endl;
-        return OpenCVMatrix;
+    if(dst.empty())
+        dst.create(rows, cols, CV_16UC1);
+    else if(dst.rows != rows || dst.cols != cols || dst.type() != CV_16UC1) {
+        std::cerr << "Error: destination buffer does not match the image size" << std::endl;
+        return false;
     }
 
-    if(pixelDataset == nullptr) {
+    DcmElement *element = nullptr;
+    if(dataset->findAndGetElement(DCM_PixelData, element).bad() || element == nullptr) {
         std::cerr << "Error: empty pixelData" << std::endl;
-        return OpenCVMatrix;
+        return false;
+    }
+    auto *pixel_data = static_cast<DcmPixelData*>(element);
+
+    ///Кадр (сжатый или нет) декодируется прямо в память dst, без промежуточной
+    ///распаковки всего датасета и последующего копирования
+    Uint32 frame_size = 0;
+    if(pixel_data->getUncompressedFrameSize(dataset, frame_size).bad()
+       || frame_size < dst.total() * dst.elemSize() || !dst.isContinuous()) {
+        ///Нестандартный кадр: обычный путь через распакованный датасет
+        cv::Mat view = extractImageView();
+        if(view.empty() || view.size() != dst.size())
+            return false;
+        view.copyTo(dst);
+        return true;
     }
 
-    ///Добавление данных изображения в начальную матрицу
-    cv::Mat tmpMat = cv::Mat(rows, cols, CV_16UC1);
-    for(int i = 0; i != rows; i++)
-        for(int j = 0; j != cols; j++)
-            tmpMat.at<uint16_t>(i, j) = pixelDataset[i * cols + j];
+    ///Кадр может быть на байт длиннее среза (выравнивание до четного)
+    std::vector<uchar> padded;
+    void *target = dst.data;
+    if(frame_size != dst.total() * dst.elemSize()) {
+        padded.resize(frame_size);
+        target = padded.data();
+    }
 
-    /// Если сжатие не требуется
-    if(compressScale.first == 0.0f && compressScale.second == 0.0f)
-        return tmpMat;
-    
-    /// Иначе сжимаем
-    cv::resize(tmpMat, OpenCVMatrix, cv::Size((uint16_t)((float)rows / compressScale.first),
-                                              (uint16_t)((float)cols / compressScale.second)));
+    Uint32 start_fragment = 0;
+    OFString color_model;
+    OFCondition status = pixel_data->getUncompressedFrame(dataset, 0, start_fragment,
+                                                          target, frame_size, color_model);
+    if(status.bad()) {
+        std::cerr << "Error: cannot decode pixel data (" << status.text() << ")" << std::endl;
+        return false;
+    }
+    if(target != dst.data)
+        std::memcpy(dst.data, target, dst.total() * dst.elemSize());
+    return true;
+}
 
-    //delete[] pixelDataset;
+cv::Mat DICOM::extractImage() {
+    cv::Mat OpenCVMatrix;
+    extractImage(OpenCVMatrix);
     return OpenCVMatrix;
 }
 
-cv::Mat DICOM::extractImageCLAHE(){
-    ///Инициализация пустой матрицы
-    cv::Mat openCVMatrix(0, 0, CV_8UC1);
-
-    ///Поиск размеров матрицы
-    uint16_t rows, cols;
-    dataset.findAndGetUint16(DCM_Rows, rows);
-    dataset.findAndGetUint16(DCM_Columns, cols);
+cv::Mat DICOM::extractImage(std::pair<float, float> compressScale) {
+    cv::Mat view = extractImageView();
+    if(view.empty())
+        return view;
 
-    ///Создание матрицы значений пикселей из датасета
-    const uint16_t *pixelDataset = new uint16_t[rows * cols];
-    if(dataset.findAndGetUint16Array(DCM_PixelData, pixelDataset).bad()) {
-        std::cerr << "Error: cannot access Patient's Info!" << std::endl;
-        return openCVMatrix;
-    }
+    /// Если сжатие не требуется
+    if(compressScale.first == 0.0f && compressScale.second == 0.0f)
+        return view.clone();
 
-    if (pixelDataset == nullptr) {
-        std::cerr << "Error: empty pixelData" << std::endl;
-        return openCVMatrix;
-    }
+    /// Иначе сжимаем (cv::Size - это ширина, высота)
+    cv::Mat OpenCVMatrix;
+    cv::resize(view, OpenCVMatrix, cv::Size((int)((float)view.cols / compressScale.second),
+                                            (int)((float)view.rows / compressScale.first)),
+               0, 0, cv::INTER_AREA);
+    return OpenCVMatrix;
+}
 
-    ///Добавление данных из датасета в "сырую" матрицу
-    cv::Mat raw(rows, cols, CV_16UC1);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++)
-            raw.at<uint16_t>(i, j) = pixelDataset[i * rows + j];
-    }
+cv::Mat DICOM::extractImageCLAHE(){
+    cv::Mat view = extractImageView();
+    if(view.empty())
+        return view;
 
     ///Адаптивная коррекия гистограммы с ограниченной контрастностью
     ///Contrast limited adaptive histogram equalization (CLAHE)
+    cv::Mat raw;
     cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(4.0, cv::Size(8,8));
-    clahe->apply(raw, raw);
-
-    ///Перенос данных из сырого 16-битного изображения в исходное 8-битное
-    openCVMatrix = cv::Mat(rows, cols, CV_8UC1);
-    for(int i = 0; i < rows; i++) {
-        for(int j = 0; j < cols; j++)
-            openCVMatrix.at<uint8_t>(i, j) = static_cast<uint8_t> (raw.at<uint16_t>(i, j) / 256);
-    }
+    clahe->apply(view, raw);
 
+    ///Перенос данных из сырого 16-битного изображения в 8-битное
+    cv::Mat openCVMatrix;
+    raw.convertTo(openCVMatrix, CV_8UC1, 1.0 / 256.0);
     return openCVMatrix;
 }
 
 int16_t DICOM::extractLargestValue() {
     int16_t largestValue = 0;
-    dataset.findAndGetSint16(DCM_LargestImagePixelValue, largestValue);
+    dataset->findAndGetSint16(DCM_LargestImagePixelValue, largestValue);
     return largestValue;
 }
 
 std::pair<float, float> DICOM::extractSpaces() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFStringArray(DCM_PixelSpacing, data);
+    condition = dataset->findAndGetOFStringArray(DCM_PixelSpacing, data);
     if(condition.bad())
         throw std::runtime_error(condition.text());
     auto parts = separateData(data);
@@ -166,7 +188,7 @@ std::pair<float, float> DICOM::extractSpaces(std::pair<float, float> compressSca
 cv::Point3f DICOM::extractPosition() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFStringArray(DCM_ImagePositionPatient, data);
+    condition = dataset->findAndGetOFStringArray(DCM_ImagePositionPatient, data);
     cv::Point3f result;
     if(condition.bad())
         throw std::runtime_error(condition.text());
@@ -181,7 +203,7 @@ cv::Point3f DICOM::extractPosition() {
 std::array<float, 6> DICOM::extractOrientation() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFStringArray(DCM_ImageOrientationPatient, data);
+    condition = dataset->findAndGetOFStringArray(DCM_ImageOrientationPatient, data);
     std::array<float, 6> result({0});
     if(condition.bad())
         throw std::runtime_error(condition.text());
@@ -194,10 +216,39 @@ std::array<float, 6> DICOM::extractOrientation() {
     return result;
 }
 
+std::pair<float, float> DICOM::extractRescale() {
+    Float64 slope = 1.0, intercept = 0.0;
+    if(dataset->findAndGetFloat64(DCM_RescaleSlope, slope).bad() || slope == 0.0)
+        slope = 1.0;
+    if(dataset->findAndGetFloat64(DCM_RescaleIntercept, intercept).bad())
+        intercept = 0.0;
+    return std::make_pair(static_cast<float>(slope), static_cast<float>(intercept));
+}
+
+std::pair<uint16_t, uint16_t> DICOM::extractSize() {
+    uint16_t rows = 0, cols = 0;
+    dataset->findAndGetUint16(DCM_Rows, rows);
+    dataset->findAndGetUint16(DCM_Columns, cols);
+    return std::make_pair(rows, cols);
+}
+
+std::string DICOM::extractSeriesUID() {
+    OFString data;
+    if(dataset->findAndGetOFString(DCM_SeriesInstanceUID, data).bad())
+        return std::string();
+    return data.c_str();
+}
+
+bool DICOM::extractPixelSigned() {
+    uint16_t representation = 0;
+    dataset->findAndGetUint16(DCM_PixelRepresentation, representation);
+    return representation == 1;
+}
+
 std::string DICOM::extractResearchType() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFString(DCM_Modality, data);
+    condition = dataset->findAndGetOFString(DCM_Modality, data);
     if(condition.bad())
         std::cout << "cannot define the type of research" << std::endl;
     return data.c_str();
@@ -206,7 +257,7 @@ std::string DICOM::extractResearchType() {
 std::string DICOM::extractScanningSequence() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFStringArray(DCM_ScanningSequence, data);
+    condition = dataset->findAndGetOFStringArray(DCM_ScanningSequence, data);
     if(condition.bad())
         std::cout << "cannot define method of research" << std::endl;
     return data.c_str();
@@ -215,7 +266,7 @@ std::string DICOM::extractScanningSequence() {
 std::string DICOM::extractDate() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFString(DCM_StudyDate, data);
+    condition = dataset->findAndGetOFString(DCM_StudyDate, data);
     if(condition.bad())
         return std::string();
     return data.c_str();
@@ -224,7 +275,7 @@ std::string DICOM::extractDate() {
 std::string DICOM::extractTime() {
     OFCondition condition;
     OFString data;
-    condition = dataset.findAndGetOFString(DCM_StudyTime, data);
+    condition = dataset->findAndGetOFString(DCM_StudyTime, data);
     if(condition.bad())
         return std::string();
     return data.c_str();
@@ -3,16 +3,27 @@
 
 #include "dcmtk/dcmdata/dctk.h"
 #include "dcmtk/dcmimgle/dcmimage.h"
-#include "dcmtk/dcmjpeg/djdecode.h"
 #include <opencv2/opencv.hpp>
 
 
 class DICOM {
 public:
     explicit DICOM(const std::string& path);
+    /// @brief Чтение файла
+    /// @param path - Путь к файлу
+    /// @param header_only - Читать только заголовок, до данных пикселей.
+    ///                      Методы extractImage* для такого объекта недоступны
+    DICOM(const std::string& path, bool header_only);
     virtual ~DICOM()=default;
+    /// Датасет ссылается на собственный файл, копирование запрещено
+    DICOM(const DICOM&) = delete;
+    DICOM& operator=(const DICOM&) = delete;
+
+    /// Подключение кодеков для декодирования сжатых файлов (один раз на процесс, см. DICOM_CODECS)
+    static void                 registerCodecs();
 private:
-    DcmDataset                  dataset;       /// Данные из файла
+    DcmFileFormat               file;          /// Прочитанный файл (владеет данными)
+    DcmDataset*                 dataset;       /// Датасет внутри file
 public:
     /// @brief Переводит матрицу изображения из 16-битной в 8-битную
     /// @param divider - Делитель исходного 16-битного числа,
@@ -25,7 +36,15 @@ public:
     /// @return Матрица размера исходного изображения с контуром головы
     cv::Mat                     findHeadSurface(uint8_t threshold);
 public:
-    /// Возвращает матрицу изображения, пригодную для работы с openCV
+    /// Возвращает матрицу изображения без копирования: заголовок cv::Mat
+    /// над данными пикселей датасета. Действителен, пока жив объект DICOM
+    cv::Mat                     extractImageView();
+    /// Декодирует изображение в буфер вызывающего. Если dst пуст, он выделяется,
+    /// иначе должен иметь размер среза и тип CV_16UC1 (например, заголовок
+    /// над участком общего объема) и заполняется на месте.
+    /// Сжатые кадры распаковываются прямо в dst, без копии внутри датасета
+    bool                        extractImage(cv::Mat &dst);
+    /// Возвращает матрицу изображения, пригодную для работы с openCV (собственная копия)
     cv::Mat                     extractImage();
     cv::Mat                     extractImageCLAHE();
     /// Возвращает матрицу изображения, пригодную для работы с openCV,
@@ -40,6 +59,15 @@ public:
     cv::Point3f                 extractPosition();
     /// Возвращает ориентацию изображения cos's
     std::array<float, 6>        extractOrientation();
+    /// Возвращает true, если значения пикселей знаковые (PixelRepresentation = 1)
+    bool                        extractPixelSigned();
+    /// Возвращает коэффициенты перевода в единицы модальности (RescaleSlope, RescaleIntercept),
+    /// при их отсутствии - (1, 0)
+    std::pair<float, float>     extractRescale();
+    /// Возвращает размеры изображения (строки, столбцы)
+    std::pair<uint16_t, uint16_t> extractSize();
+    /// Возвращает уникальный идентификатор серии (SeriesInstanceUID)
+    std::string                 extractSeriesUID();
     /// Возвращает тип исследования
     std::string                 extractResearchType();
     /// Возвращает импульсную последовательность проведенного исследования
@@ -51,7 +79,7 @@ public:
 
 private:
     /// Извлечение датасета из зашифрованного (сжатого) DICOM файла
-    DcmDataset                  extractDataset(const std::string& path);
+    DcmDataset*                 extractDataset(const std::string& path, bool header_only = false);
     /// Разделяет данные, полученные от OFStringArray
     std::pair<OFString, OFString> separateData(const OFString& src);
 
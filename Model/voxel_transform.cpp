@@ -0,0 +1,64 @@
+#include "voxel_transform.hpp"
+#include "parallel.hpp"
+
+
+VOXEL_TRANSFORM::Affine VOXEL_TRANSFORM::sliceAffine(const std::array<float, 6> &orientation,
+                                                     const std::pair<float, float> &spaces,
+                                                     const cv::Point3f &position) {
+    Affine affine;
+    affine.origin = {position.x, position.y, position.z};
+    affine.col_step = {orientation[0] * spaces.first,
+                       orientation[1] * spaces.first,
+                       orientation[2] * spaces.first};
+    affine.row_step = {orientation[3] * spaces.second,
+                       orientation[4] * spaces.second,
+                       orientation[5] * spaces.second};
+    return affine;
+}
+
+VOXEL_TRANSFORM::Affine VOXEL_TRANSFORM::volumeAffine(const std::array<float, 6> &orientation,
+                                                      const std::pair<float, float> &spaces,
+                                                      const cv::Point3f &position,
+                                                      float slice_spacing) {
+    Affine affine = sliceAffine(orientation, spaces, position);
+    // Нормаль - векторное произведение направлений строки и столбца
+    cv::Vec3f row_dir(orientation[0], orientation[1], orientation[2]);
+    cv::Vec3f col_dir(orientation[3], orientation[4], orientation[5]);
+    cv::Vec3f step = row_dir.cross(col_dir) * slice_spacing;
+    affine.slice_step = {step[0], step[1], step[2]};
+    return affine;
+}
+
+void VOXEL_TRANSFORM::Points::resize(size_t count) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+}
+
+std::vector<cv::Point3f> VOXEL_TRANSFORM::Points::toPoint3f() const {
+    std::vector<cv::Point3f> points(size());
+    /// Блоки достаточно крупные, чтобы накладные расходы потоков не были заметны
+    constexpr size_t block = 1 << 16;
+    const size_t blocks = (points.size() + block - 1) / block;
+    PARALLEL::parallel_for(blocks, [&](size_t b) {
+        const size_t end = std::min(points.size(), (b + 1) * block);
+        for(size_t i = b * block; i != end; ++i)
+            points[i] = cv::Point3f(x[i], y[i], z[i]);
+    });
+    return points;
+}
+
+void VOXEL_TRANSFORM::transform(const Affine &affine, const cv::Point *pixels, size_t count,
+                                float *x, float *y, float *z) {
+    // Коэффициенты в локальных переменных, чтобы компилятор векторизовал цикл
+    const float ox = affine.origin[0], oy = affine.origin[1], oz = affine.origin[2];
+    const float cx = affine.col_step[0], cy = affine.col_step[1], cz = affine.col_step[2];
+    const float rx = affine.row_step[0], ry = affine.row_step[1], rz = affine.row_step[2];
+    for(size_t i = 0; i != count; ++i) {
+        const float col = static_cast<float>(pixels[i].x);
+        const float row = static_cast<float>(pixels[i].y);
+        x[i] = cx * col + rx * row + ox;
+        y[i] = cy * col + ry * row + oy;
+        z[i] = cz * col + rz * row + oz;
+    }
+}
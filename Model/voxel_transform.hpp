@@ -0,0 +1,63 @@
+#ifndef VOXEL_TRANSFORM_HPP
+#define VOXEL_TRANSFORM_HPP
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+/// Перевод пикселей срезов в координаты пациента пачками.
+/// Для среза DICOM преобразование аффинное: world = position + col * u + row * v,
+/// где u, v - направления строки и столбца, умноженные на размер пикселя.
+/// Вместо умножения матриц 4x4 на каждый пиксель координаты контура собираются
+/// для всего среза и переводятся одним проходом в буфер структуры массивов
+namespace VOXEL_TRANSFORM {
+    /// Аффинное преобразование одного среза
+    struct Affine {
+        std::array<float, 3> origin;    /// Положение пикселя (0, 0)
+        std::array<float, 3> col_step;  /// Смещение на один столбец
+        std::array<float, 3> row_step;  /// Смещение на одну строку
+        std::array<float, 3> slice_step = {0.0f, 0.0f, 0.0f};   /// Смещение на один срез (для объема)
+    };
+
+    /// @brief Преобразование для среза
+    /// @param orientation Image Orientation (Patient): направления строки и столбца
+    /// @param spaces Pixel Spacing (вдоль строки, вдоль столбца)
+    /// @param position Image Position (Patient) среза
+    Affine sliceAffine(const std::array<float, 6> &orientation,
+                       const std::pair<float, float> &spaces,
+                       const cv::Point3f &position);
+
+    /// @brief Преобразование для объема из срезов, упорядоченных вдоль нормали
+    /// @param position Image Position (Patient) первого среза
+    /// @param slice_spacing Расстояние между срезами
+    Affine volumeAffine(const std::array<float, 6> &orientation,
+                        const std::pair<float, float> &spaces,
+                        const cv::Point3f &position,
+                        float slice_spacing);
+
+    /// Облако точек в виде структуры массивов (x, y, z хранятся раздельно)
+    struct Points {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> z;
+
+        size_t size() const { return x.size(); }
+        void resize(size_t count);
+        /// @brief Перевод в массив точек (параллельно)
+        std::vector<cv::Point3f> toPoint3f() const;
+    };
+
+    /// @brief Переводит пиксели в координаты пациента
+    /// @param affine Преобразование среза
+    /// @param pixels Координаты пикселей (x - столбец, y - строка)
+    /// @param count Количество пикселей
+    /// @param x, y, z Результат, по count значений
+    void transform(const Affine &affine, const cv::Point *pixels, size_t count,
+                   float *x, float *y, float *z);
+}
+
+
+#endif //VOXEL_TRANSFORM_HPP
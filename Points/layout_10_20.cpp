@@ -1,4 +1,5 @@
 #include "layout_10_20.hpp"
+#include "Model/trace.hpp"
 
 // General
 #include <vtkNew.h>
@@ -263,7 +264,10 @@ namespace {
         // Поиск точек начала и конца пути на конутре
         vtkNew<vtkKdTreePointLocator> kdTree;
         kdTree->SetDataSet(cleaner->GetOutput());
-        kdTree->Update();
+        {
+            TRACE_SCOPE("kd tree build");
+            kdTree->Update();
+        }
         vtkIdType iD1 = kdTree->FindClosestPoint(start_point);
         vtkIdType iD2 = kdTree->FindClosestPoint(end_point);
 
@@ -306,7 +310,10 @@ namespace {
         // Поиск точек начала и конца пути на конутре
         vtkNew<vtkKdTreePointLocator> kdTree;
         kdTree->SetDataSet(cutter->GetOutput());
-        kdTree->Update();
+        {
+            TRACE_SCOPE("kd tree build");
+            kdTree->Update();
+        }
         vtkIdType iD1 = kdTree->FindClosestPoint(start_point);
         vtkIdType iD2 = kdTree->FindClosestPoint(end_point);
 
@@ -705,6 +712,7 @@ vtkSmartPointer<vtkPoints> LAYOUT_10_20::mark(vtkPolyData* model,
                                               double* tragus_l,
                                               double* tragus_r,
                                               double* center) {
+    TRACE_SCOPE("10-20 mark");
     // Связываем заданные точки и точки на поверхности модели
     matchPoints(kd_tree, nasion, inion, tragus_l, tragus_r);
 
@@ -1,4 +1,5 @@
 #include "strech_grid.hpp"
+#include "Model/trace.hpp"
 #include <vtkTriangle.h>
 #include <vtkTransform.h>
 #include <vtkAppendPolyData.h>
@@ -218,6 +219,7 @@ vtkSmartPointer<vtkPoints> STRECH_GRID::stretchGridOnModel(int num_of_points,
                                                            vtkKdTreePointLocator* kd_tree,
                                                            vtkOBBTree* obb_tree,
                                                            vtkPolyData* grid_poly_data) {
+    TRACE_SCOPE("stretch grid");
     // Базовая сетка с заданными параметрами, расположенная в начале координат в плоскости XY
     vtkSmartPointer<vtkPoints> points = baseGrid(num_of_points, spacing);
 
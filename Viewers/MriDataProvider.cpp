@@ -1,76 +1,266 @@
 #include "MriDataProvider.h"
+#include "Model/mesh_export.hpp"
 #include "Model/model_builder.hpp"
+#include "Model/study_volume.hpp"
+#include "Model/study_cache.hpp"
+#include "Model/job.hpp"
+#include "Model/trace.hpp"
 #include "Points/layout_10_20.hpp"
 #include "Points/strech_grid.hpp"
 
 #include <vtkPolyDataMapper.h>
 #include <vtkProperty.h>
-#include <vtkImageReslice.h>
-#include <vtkMatrix4x4.h>
-#include <vtkMath.h>
-#include <vtkTransform.h>
 #include <vtkPointData.h>
 #include <vtkDataArray.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-#include <thread>
+#include <chrono>
 
 
-static void buildModelInThread() {
-    MriDataProvider::getInstance().buildModel();
-}
-
-
-bool MriDataProvider::setDirectory(QString dir) {
+void MriDataProvider::setDirectory(QString dir) {
     directory = dir.toStdString();
     // Убираем "file://"
     directory.erase(directory.begin(), directory.begin() + 7);
 
+    // Предыдущая загрузка больше не нужна
+    cancelLoading();
+
     if(model_actor)
         model_viewer->getRenderer()->removeActor(model_actor);
-
-    // Запускаем построение модели в отдельном потоке
-    std::thread t1(buildModelInThread);
+    model = nullptr;
+    model_actor = nullptr;
 
     resetProviderData();
 
-    // Сохраняем данные исследования для vtk
-    if(!this->readDirectoryVtk()) {
-        t1.join();
-        return false;
+    // Нужно вернуть к стандартному значению, иначе qt ломает разбор чисел в DICOM.
+    // Локаль глобальна, поэтому задается здесь, до запуска фонового потока
+    setlocale(LC_ALL, "C");
+
+    // Завершившиеся задачи больше не храним
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](std::future<void> &job) {
+        return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), jobs.end());
+
+    unsigned id = ++job_id;
+    job_token = std::make_shared<JOB::Token>([this, id](double progress, const std::string &stage) {
+        QString stage_name = QString::fromStdString(stage);
+        QMetaObject::invokeMethod(this, [this, id, progress, stage_name]() {
+            onLoadingProgress(id, progress, stage_name);
+        }, Qt::QueuedConnection);
+    });
+    jobs.emplace_back(std::async(std::launch::async, &MriDataProvider::runLoadJob,
+                                 this, id, job_token, directory));
+
+    loading = true;
+    loadingProgress = 0.0;
+    loadingStage = "index";
+    emit loadingChanged();
+    emit loadingProgressChanged();
+}
+
+void MriDataProvider::cancelLoading() {
+    if(job_token)
+        job_token->cancel();
+    job_token = nullptr;
+    // Результаты отмененной задачи будут отброшены по номеру
+    ++job_id;
+    if(loading) {
+        loading = false;
+        emit loadingChanged();
+    }
+}
+
+void MriDataProvider::runLoadJob(unsigned id,
+                                 std::shared_ptr<JOB::Token> token,
+                                 std::string study_directory) {
+    JOB::Scope scope(token);
+    TRACE_SCOPE("study open");
+    QString error;
+    try {
+        // Индекс по заголовкам нужен и для ключа кэша, и для чтения исследования
+        DICOM_LOADER::StudyIndex index = DICOM_LOADER::index(study_directory);
+        if(index.files.size() < 20)
+            throw std::runtime_error("Недостаточно входных данных в папке: " +
+                                     std::to_string(index.files.size()));
+        std::vector<std::string> files;
+        files.reserve(index.files.size());
+        for(auto &header: index.files)
+            files.push_back(header.path);
+        std::string cache_key = STUDY_CACHE::key(index.series_uid, files, MODEL_BUILDER::parameters());
+        JOB::checkpoint();
+
+        // Повторное открытие: объем и модель берутся из кэша,
+        // декодирование и построение модели пропускаются
+        vtkSmartPointer<vtkImageData> volume_data = STUDY_CACHE::loadVolume(cache_key);
+        vtkSmartPointer<vtkPolyData> cached_model = volume_data ? STUDY_CACHE::loadMesh(cache_key) : nullptr;
+        std::shared_ptr<const STUDY_VOLUME::Volume> volume;
+        if(!volume_data || !cached_model) {
+            // Исследование декодируется один раз и используется и просмотрщиками, и построением модели.
+            // Пока догружаются срезы, просмотрщики показывают грубый уровень пирамиды
+            volume = STUDY_VOLUME::read(index, [this, id](const STUDY_VOLUME::Volume &partial,
+                                                          vtkImageData *level) {
+                postVolume(id, STUDY_VOLUME::orient(partial, level), true);
+            });
+            if(!volume)
+                throw std::runtime_error("Не удалось прочитать исследование");
+            JOB::checkpoint();
+            // Уровень 2x переводится в систему пациента намного быстрее полного объема
+            postVolume(id, STUDY_VOLUME::orient(*volume, volume->pyramid.front()), true);
+            JOB::progress(0.0, "reslice");
+            volume_data = STUDY_VOLUME::orient(*volume);
+            STUDY_CACHE::saveVolume(cache_key, volume_data);
+            STUDY_CACHE::saveMeta(cache_key, {{"series_uid", index.series_uid},
+                                              {"directory", study_directory},
+                                              {"slices", std::to_string(index.files.size())}});
+        }
+        JOB::checkpoint();
+
+        // Просмотрщики обновляются сразу, не дожидаясь модели
+        postVolume(id, volume_data, false);
+
+        // Модель сразу уходит в просмотр, файлы пишутся в фоне
+        vtkSmartPointer<vtkPolyData> model_data = cached_model;
+        if(!model_data)
+            model_data = MODEL_BUILDER::build(volume, model_directory, model_filename, cache_key,
+                                              MODEL_BUILDER::Backend::ScaleSpace, false);
+        JOB::checkpoint();
+
+        // Копия для экспорта снимается здесь, до передачи модели в поток GUI:
+        // после invokeMethod модель может читаться отрисовкой одновременно с DeepCopy
+        if(!cached_model) {
+            MESH_EXPORT::enqueue(model_data, model_directory, model_filename, MESH_EXPORT::ALL,
+                                 [this](bool ok) {
+                QMetaObject::invokeMethod(this, [this, ok]() {
+                    emit modelExported(ok);
+                }, Qt::QueuedConnection);
+            });
+        }
+        QMetaObject::invokeMethod(this, [this, id, model_data]() {
+            onModelLoaded(id, model_data);
+        }, Qt::QueuedConnection);
+    } catch(const JOB::Cancelled &) {
+        std::cout << "Study loading cancelled" << std::endl;
+        return;
+    } catch(const std::exception &e) {
+        std::cout << e.what() << std::endl;
+        error = QString::fromStdString(e.what());
+    }
+
+    QMetaObject::invokeMethod(this, [this, id, error]() {
+        onLoadingFinished(id, error);
+    }, Qt::QueuedConnection);
+}
+
+void MriDataProvider::postVolume(unsigned id, vtkSmartPointer<vtkImageData> volume_data, bool preview) {
+    QMetaObject::invokeMethod(this, [this, id, volume_data, preview]() {
+        onVolumeLoaded(id, volume_data, preview);
+    }, Qt::QueuedConnection);
+}
+
+void MriDataProvider::onVolumeLoaded(unsigned id, vtkSmartPointer<vtkImageData> volume_data, bool preview) {
+    if(id != job_id)
+        return;
+
+    // Более подробный уровень того же исследования: срезы остаются на прежнем
+    // месте в пространстве, окна просмотрщиков не пересоздаются
+    bool refine = shown_job == id;
+    shown_job = id;
+    double old_origin[3], old_spacing[3];
+    data->GetOrigin(old_origin);
+    data->GetSpacing(old_spacing);
+
+    // Данные не копируются, а разделяются с загруженным объемом
+    data->ShallowCopy(volume_data);
+
+    int *dims = data->GetDimensions();
+    double *origin = data->GetOrigin();
+    double *spacing = data->GetSpacing();
+    for(int i = 0; i != 3; ++i) {
+        if(refine) {
+            double position = old_origin[i] + current_slice[i] * old_spacing[i];
+            int slice = static_cast<int>(std::lround((position - origin[i]) / spacing[i]));
+            current_slice[i] = std::max(0, std::min(dims[i] - 1, slice));
+        } else {
+            current_slice[i] = dims[i] / 2;
+        }
     }
 
     // Обновление данных в просмотрщиках проекций (plane_viewer)
-    for(int i = 0; i != 3; ++i)
-        plane_viewer[i]->getRenderer()->setData(data);
+    for(int i = 0; i != 3; ++i) {
+        plane_viewer[i]->getRenderer()->setData(data, refine);
+        if(refine)
+            plane_viewer[i]->getRenderer()->setSlice(current_slice[i]);
+    }
 
     // Обновление данных в просмотрщиках проекций (plane_widget)
-    model_viewer->getRenderer()->setData(data);
+    model_viewer->getRenderer()->setData(data, refine);
+    if(refine) {
+        for(int i = 0; i != 3; ++i)
+            model_viewer->getRenderer()->setSlice(i, current_slice[i]);
+    }
 
     // Обновляем размерность для слайдеров
-    slices_0 = data->GetDimensions()[0];
-    slices_1 = data->GetDimensions()[1];
-    slices_2 = data->GetDimensions()[2];
+    slices_0 = dims[0];
+    slices_1 = dims[1];
+    slices_2 = dims[2];
     emit changedSlices_0();
     emit changedSlices_1();
     emit changedSlices_2();
+    if(refine) {
+        for(int i = 0; i != 3; ++i)
+            emit sliceRescaled(i, current_slice[i]);
+    }
 
-    // Обновляем занчение ширины полосы интенсивностей
+    // Обновляем занчение ширины полосы интенсивностей.
+    // Усредненные уровни пирамиды уже по диапазону, поэтому при уточнении он только растет
     double range[2];
     data->GetPointData()->GetScalars()->GetRange(range);
-    windowRange = range[1] - range[0];
-    emit windowRangeChanged();
+    int range_width = static_cast<int>(range[1] - range[0]);
+    if(!refine || range_width > windowRange) {
+        windowRange = range_width;
+        emit windowRangeChanged();
+    }
 
     // Задаем значения window-level в plane_widget
-    model_viewer->getRenderer()->setWindow(windowRange);
-    model_viewer->getRenderer()->setLevel(windowRange / 2);
+    if(!refine) {
+        model_viewer->getRenderer()->setWindow(windowRange);
+        model_viewer->getRenderer()->setLevel(windowRange / 2);
+    }
+
+    if(!preview)
+        emit volumeReady();
+}
 
-    // Дожидаемся выполнения потока
-    t1.join();
+void MriDataProvider::onModelLoaded(unsigned id, vtkSmartPointer<vtkPolyData> model_data) {
+    if(id != job_id)
+        return;
+
+    model = model_data;
+    updateModelActor();
 
     // Передаем полученную модель в просмотр
     model_viewer->getRenderer()->addActor(model_actor);
 
-    return true;
+    emit modelReady();
+}
+
+void MriDataProvider::onLoadingProgress(unsigned id, double progress, const QString &stage) {
+    if(id != job_id)
+        return;
+    loadingProgress = progress;
+    loadingStage = stage;
+    emit loadingProgressChanged();
+}
+
+void MriDataProvider::onLoadingFinished(unsigned id, const QString &error) {
+    if(id != job_id)
+        return;
+    job_token = nullptr;
+    loading = false;
+    emit loadingChanged();
+    if(!error.isEmpty())
+        emit loadingFailed(error);
 }
 
 void MriDataProvider::setWindow(int value) {
@@ -93,6 +283,9 @@ void MriDataProvider::pickBasePoint(int point) {
 }
 
 void MriDataProvider::buildPoints10_20() {
+    // Модель еще строится
+    if(!model)
+        return;
     // Проверка существования базовых точек
     for(int i = 0; i != 4; ++i) {
         if(!pointIsInitialized(base_points[i]))
@@ -106,11 +299,13 @@ void MriDataProvider::buildPoints10_20() {
                                base_points[4]);
     // Строим деревья
     if(!obb_tree) {
+        TRACE_SCOPE("obb tree build");
         obb_tree = vtkSmartPointer<vtkOBBTree>::New();
         obb_tree->SetDataSet(model);
         obb_tree->BuildLocator();
     }
     if(!kd_tree) {
+        TRACE_SCOPE("kd tree build");
         kd_tree = vtkSmartPointer<vtkKdTreePointLocator>::New();
         kd_tree->SetDataSet(model);
         kd_tree->BuildLocator();
@@ -130,6 +325,8 @@ void MriDataProvider::buildPoints10_20() {
 }
 
 void MriDataProvider::buildNavPoints() {
+    if(!model || !points10_20)
+        return;
     // Удаляем старые точки с просмотра
     if(nav_points_actor)
         model_viewer->getRenderer()->removeActor(nav_points_actor);
@@ -154,6 +351,14 @@ MriDataProvider::MriDataProvider() {
     this->initMap10_20();
 }
 
+MriDataProvider::~MriDataProvider() {
+    // Фоновые задачи обращаются к провайдеру, дожидаемся их завершения
+    cancelLoading();
+    for(auto &job: jobs)
+        job.wait();
+    MESH_EXPORT::wait();
+}
+
 MriDataProvider& MriDataProvider::getInstance() {
     static MriDataProvider provider;
     return provider;
@@ -167,9 +372,7 @@ void MriDataProvider::addModelViewer(QVTKModelViewerItem *item) {
     model_viewer = item;
 }
 
-void MriDataProvider::buildModel() {
-    model = MODEL_BUILDER::build(directory, model_directory, model_filename);
-
+void MriDataProvider::updateModelActor() {
     vtkNew<vtkPolyDataMapper> mapper;
     mapper->SetInputData(model);
 
@@ -207,70 +410,8 @@ void MriDataProvider::getPoint10_20(const std::string& name, double point[3]) {
         points10_20->GetPoint(points10_20map[name], point);
 }
 
-bool MriDataProvider::readDirectoryVtk() {
-    // Нужно вернуть к стандартному значению, иначе qt ультует vtk
-    setlocale(LC_ALL, "C");
-    // Читаем директорию
-    this->UpdateInformation();
-    this->SetDirectoryName(directory.c_str());
-    this->Update();
-    if(this->GetNumberOfDICOMFileNames() < 20) {
-        std::cout << "Недостаточно входных данных в папке: ";
-        std::cout << this->GetNumberOfDICOMFileNames()<< std::endl;
-        return false;
-    }
-
-    // Ищем граничные координаты
-    double bounds[6];
-    this->GetOutput()->GetBounds(bounds);
-
-    // Поворот набора точек - подготовка к последующей трансформации
-    vtkNew<vtkImageReslice> flip;
-    flip->SetInputData(this->GetOutput());
-    flip->SetResliceAxesOrigin(0, (bounds[3] - bounds[2]), (bounds[5] - bounds[4]));
-    flip->SetResliceAxesDirectionCosines(1,0,0, 0,-1,0, 0,0,-1);
-    flip->Update();
-
-    vtkNew<vtkMatrix4x4> matrix;
-    // Составляем матрицу для перевода точек из системы координат vtk в dicom'овские
-    float *position = this->GetImagePositionPatient();
-    float *orientation = this->GetImageOrientationPatient();
-    float *xdir = &orientation[0];
-    float *ydir = &orientation[3];
-    float zdir[3];
-    vtkMath::Cross(xdir, ydir, zdir);
-    for(int i = 0; i != 3; ++i) {
-        matrix->Element[i][0] = xdir[i];
-        matrix->Element[i][1] = ydir[i];
-        matrix->Element[i][2] = zdir[i];
-        matrix->Element[i][3] = position[i];
-    }
-    matrix->Element[3][0] = 0;
-    matrix->Element[3][1] = 0;
-    matrix->Element[3][2] = 0;
-    matrix->Element[3][3] = 1;
-    matrix->Modified();
-    matrix->Invert();
-
-    // Длеаем трансофрмацию с матрицей
-    vtkNew<vtkTransform> tr;
-    tr->SetMatrix(matrix);
-    tr->Update();
-
-    // monke flip
-    vtkNew<vtkImageReslice> monke;
-    monke->SetInputData(flip->GetOutput());
-    monke->SetResliceTransform(tr);
-    monke->SetInterpolationModeToLinear();
-    monke->AutoCropOutputOn();
-    monke->Update();
-
-    // Сохраняем данные
-    this->data->DeepCopy(monke->GetOutput());
-    return true;
-}
-
 void MriDataProvider::setSlice(int i, int slice) {
+    current_slice[i] = slice;
     plane_viewer[i]->getRenderer()->setSlice(slice);
     model_viewer->getRenderer()->setSlice(i, slice);
 }
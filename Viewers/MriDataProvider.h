@@ -5,25 +5,36 @@
 #include "QVTKPlaneViewer.h"
 #include "QVTKModelViewer.h"
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
+#include <future>
 #include <QObject>
 #include <QString>
-#include <vtkDICOMImageReader.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
 #include <vtkKdTreePointLocator.h>
 #include <vtkOBBTree.h>
 
 
-class MriDataProvider: 
-    public QObject,
-    private vtkDICOMImageReader {
+namespace STUDY_VOLUME {
+    struct Volume;
+}
+
+namespace JOB {
+    class Token;
+}
+
+class MriDataProvider: public QObject {
 
     Q_OBJECT
     Q_PROPERTY(int slices_0 READ getSlices_0 WRITE setSlices_0 NOTIFY changedSlices_0)
     Q_PROPERTY(int slices_1 READ getSlices_1 WRITE setSlices_1 NOTIFY changedSlices_1)
     Q_PROPERTY(int slices_2 READ getSlices_2 WRITE setSlices_2 NOTIFY changedSlices_2)
     Q_PROPERTY(int windowRange READ getWindowRange WRITE setWindowRange NOTIFY windowRangeChanged)
+    Q_PROPERTY(bool loading READ isLoading NOTIFY loadingChanged)
+    Q_PROPERTY(double loadingProgress READ getLoadingProgress NOTIFY loadingProgressChanged)
+    Q_PROPERTY(QString loadingStage READ getLoadingStage NOTIFY loadingProgressChanged)
 public:
     int slices_0 = 100;
     int slices_1 = 100;
@@ -37,14 +48,33 @@ public:
     int getSlices_1() const {return slices_1;}
     int getSlices_2() const {return slices_2;}
     int getWindowRange() const {return windowRange;}
+    bool isLoading() const {return loading;}
+    double getLoadingProgress() const {return loadingProgress;}
+    QString getLoadingStage() const {return loadingStage;}
 signals:
     void changedSlices_0();
     void changedSlices_1();
     void changedSlices_2();
     void windowRangeChanged();
+    void loadingChanged();
+    void loadingProgressChanged();
+    // Объем исследования в полном разрешении передан в просмотрщики
+    void volumeReady();
+    // Номер среза пересчитан при смене уровня пирамиды (для слайдеров)
+    void sliceRescaled(int axis, int slice);
+    // Модель головы передана в просмотр
+    void modelReady();
+    // Фоновое сохранение модели в файлы (DAE, PLY, STL) завершилось
+    void modelExported(bool ok);
+    // Загрузка исследования завершилась ошибкой
+    void loadingFailed(QString message);
 
 public slots:
-    bool setDirectory(QString directory);
+    // Запускает фоновую загрузку исследования, отменяя текущую.
+    // Ошибки загрузки приходят позже через loadingFailed
+    void setDirectory(QString directory);
+    // Отменяет текущую загрузку
+    void cancelLoading();
     void setSlice_0(const int&s) {setSlice(0, s);}
     void setSlice_1(const int&s) {setSlice(1, s);}
     void setSlice_2(const int&s) {setSlice(2, s);}
@@ -61,14 +91,12 @@ public:
     static MriDataProvider& getInstance();
     MriDataProvider(MriDataProvider const&) = delete;
     void operator= (MriDataProvider const&) = delete;
-    ~MriDataProvider() = default;
+    ~MriDataProvider();
 
 public:
     // Добавление ссылок на объекты, использующие провайдера
     void addPlaneViewer(QVTKPlaneViewerItem* plane_viewer);
     void addModelViewer(QVTKModelViewerItem* item);
-    // Выполнение построения актера модели
-    void buildModel();
     // Дергается из plane_viewer'a
     // Сохраняет значение пикнутой точки
     void setBasePoint(double* point);
@@ -78,8 +106,18 @@ public:
     void getPoint10_20(const std::string& name, double point[3]);
 
 private:
-    // Чтение директории с исследованием с преобразованием координат
-    bool readDirectoryVtk();
+    // Загрузка исследования в фоновом потоке. Члены провайдера не трогает,
+    // результаты передаются в поток GUI через очередь событий
+    void runLoadJob(unsigned id,
+                    std::shared_ptr<JOB::Token> token,
+                    std::string directory);
+    // Передача объема в поток GUI (preview - уменьшенный уровень пирамиды)
+    void postVolume(unsigned id, vtkSmartPointer<vtkImageData> volume_data, bool preview);
+    // Обработчики результатов загрузки (в потоке GUI)
+    void onVolumeLoaded(unsigned id, vtkSmartPointer<vtkImageData> volume_data, bool preview);
+    void onModelLoaded(unsigned id, vtkSmartPointer<vtkPolyData> model_data);
+    void onLoadingProgress(unsigned id, double progress, const QString &stage);
+    void onLoadingFinished(unsigned id, const QString &error);
     // Задание номера среза в объектах, использующих провайдера
     void setSlice(int i, int slice);
     // Проверка, задана точка или нет
@@ -88,12 +126,28 @@ private:
     void initMap10_20();
     // Сбрасывает данные провайдера при смене исследования
     void resetProviderData();
+    // Создает актера модели головы по model
+    void updateModelActor();
 
 private:
     // Директория с исследованием
     std::string directory;
+
+    // Состояние загрузки
+    bool loading = false;
+    double loadingProgress = 0.0;
+    QString loadingStage;
+    // Номер актуальной загрузки: результаты устаревших отбрасываются
+    unsigned job_id = 0;
+    std::shared_ptr<JOB::Token> job_token;
+    std::vector<std::future<void>> jobs;
+
     // Объемные данные (volume data)
     vtkSmartPointer<vtkImageData> data;
+    // Загрузка, объем которой сейчас показан (следующие уровни только уточняют его)
+    unsigned shown_job = 0;
+    // Текущие срезы просмотрщиков
+    int current_slice[3] = {0, 0, 0};
 
     // Ссылки на объекты, использующие провайдера
     QVTKModelViewerItem* model_viewer;
@@ -144,8 +144,9 @@ void QVTKModelViewerRenderer::removeActor(vtkActor *actor) {
     this->update();
 }
 
-void QVTKModelViewerRenderer::setData(vtkImageData* data) {
+void QVTKModelViewerRenderer::setData(vtkImageData* data, bool refine) {
     this->data = data;
+    data_refined = refine && plane_widget[0];
     data_changed = true;
     this->update();
 }
@@ -295,10 +296,16 @@ void QVTKModelViewerRenderer::initPlaneViewers() {
 
     if(plane_widget[0]) {
         for(int i = 0; i != 3; ++i) {
-            m_slice[i] = data->GetDimensions()[i] / 2;
+            // При уточнении уровня пирамиды срезы уже пересчитаны провайдером
+            if(!data_refined)
+                m_slice[i] = data->GetDimensions()[i] / 2;
             plane_widget[i]->SetInputData(data);
             plane_widget[i]->SetSliceIndex(m_slice[i]);
         }
+        // SetInputData сбрасывает window-level к диапазону данных
+        if(data_refined)
+            window_level_changed = true;
+        data_refined = false;
         return;
     }
 
@@ -79,7 +79,9 @@ public:
 
     void addActor(vtkActor* actor);
     void removeActor(vtkActor* actor);
-    void setData(vtkImageData* data);
+    // refine - тот же объем в более высоком разрешении (уровень пирамиды),
+    // срезы задаются через setSlice
+    void setData(vtkImageData* data, bool refine = false);
     void setSlice(int i, int slice);
     void setWindow(int window);
     void setLevel(int level);
@@ -118,6 +120,7 @@ private:
     int m_slice[3];
 
     bool data_changed = false;
+    bool data_refined = false;
     bool window_level_changed = false;
     bool slice_changed = false;
 
@@ -143,10 +143,18 @@ void QVTKPlaneViewerRenderer::render() {
     m_render_window->Render();
 }
 
-void QVTKPlaneViewerRenderer::setData(vtkImageData* data) {
+void QVTKPlaneViewerRenderer::setData(vtkImageData* data, bool refine) {
     // Вытаскиваем обновленные данные
     this->data = data;
 
+    // Уточнение уже показанного объема: достаточно подменить вход просмотрщика
+    if(refine && m_image_viewer && interaction) {
+        data_refined = true;
+        data_changed = true;
+        this->update();
+        return;
+    }
+
     // Сохраняем размеры предыдущего окна
     int* size = m_render_window->GetSize();
 
@@ -300,6 +308,19 @@ void QVTKPlaneViewerRenderer::handleEvents() {
 
 
 void QVTKPlaneViewerRenderer::updateData() {
+    if(data_refined) {
+        m_image_viewer->SetInputData(data);
+        m_image_viewer->SetSlice(m_slice);
+        // Окно и уровень задавались пользователем для предыдущего уровня
+        if(m_window) {
+            m_image_viewer->SetColorWindow(m_window);
+            m_image_viewer->SetColorLevel(m_level);
+        }
+        data_refined = false;
+        data_changed = false;
+        return;
+    }
+
     m_renderer->SetBackground(0,0,0);
     m_renderer->SetBackground2(0,0,0);
     m_renderer->GradientBackgroundOn();
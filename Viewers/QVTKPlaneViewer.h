@@ -83,7 +83,9 @@ public:
     virtual void render() override;
 
     // Обновление данных мрт/кт
-    void setData(vtkImageData* data);
+    // refine - тот же объем в более высоком разрешении (уровень пирамиды),
+    // окно и камера сохраняются, срез задается через setSlice
+    void setData(vtkImageData* data, bool refine = false);
 
     // Обновление параметров m_image_viewer
     void setSlice(int slice);
@@ -111,6 +113,7 @@ private:
 private:
     bool picking_enabled = false;
     bool data_changed = false;
+    bool data_refined = false;
     bool interaction = false;
     bool slice_changed = false;
     bool window_changed = false;
@@ -1,11 +1,13 @@
 #include "Viewers/QVTKPlaneViewer.h"
 #include "Viewers/QVTKModelViewer.h"
 #include "Viewers/MriDataProvider.h"
+#include "Model/parallel.hpp"
 #include <QQmlApplicationEngine>
 #include <QGuiApplication>
 #include <QQmlContext>
 #include <QQuickView>
 #include <QList>
+#include <vtkMultiThreader.h>
 
 
 
@@ -13,6 +15,9 @@ int main(int argc, char **argv)
 {
     QGuiApplication app(argc, argv);
 
+    // Фильтры VTK получают то же число потоков, что и PARALLEL (VTK_VIEWER_THREADS)
+    vtkMultiThreader::SetGlobalMaximumNumberOfThreads(static_cast<int>(PARALLEL::threads()));
+
     qmlRegisterType<QVTKPlaneViewerItem>("VTK", 8, 2, "VtkPlaneViewer");
     qmlRegisterType<QVTKModelViewerItem>("VTK", 8, 2, "VtkModelViewer");
 
@@ -69,6 +69,45 @@ Window {
                     }
                 }
 
+                Label {
+                    id: loading_label
+                    visible: mri_data_provider.loading
+                    text: "Загрузка: " + mri_data_provider.loadingStage
+                    anchors {
+                        left: parent.left
+                        right: parent.right
+                        top: parent.verticalCenter
+                        margins: 10
+                    }
+                }
+
+                ProgressBar {
+                    id: loading_progress
+                    visible: mri_data_provider.loading
+                    from: 0
+                    to: 1
+                    value: mri_data_provider.loadingProgress
+                    anchors {
+                        left: parent.left
+                        right: parent.right
+                        top: loading_label.bottom
+                        margins: 10
+                    }
+                }
+
+                Button {
+                    id: button_cancel
+                    visible: mri_data_provider.loading
+                    text: "Отменить загрузку"
+                    anchors {
+                        left: parent.left
+                        right: parent.right
+                        top: loading_progress.bottom
+                        margins: 10
+                    }
+                    onClicked: mri_data_provider.cancelLoading()
+                }
+
                 Button {
                     id: button_i
                     text: "Инион"
@@ -248,6 +287,19 @@ Window {
         }
     }
 
+    // При смене уровня пирамиды объема срезы остаются на месте, меняется только их номер
+    Connections {
+        target: mri_data_provider
+        onSliceRescaled: {
+            if(axis === 0)
+                slider_0.value = slice
+            else if(axis === 1)
+                slider_1.value = slice
+            else
+                slider_2.value = slice
+        }
+    }
+
     FolderDialog {
         id: open_directory_dialog
         visible: false